@@ -1,15 +1,50 @@
 #include <iostream>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 #include <queue>
-#include <vector>
+#include <deque>
 #include <map>
+#include <vector>
 #include <random>
 #include <chrono>
 #include <cmath>
-#include <tuple>
 #include <string>
+#include <sstream>
 #include <cstdio>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+#include <cstring>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <new>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#ifdef __linux__
+#define HAVE_UDP_TRANSPORT 1
+#define HAVE_THREAD_AFFINITY 1
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 #ifdef _WIN32
 #include <windows.h>
@@ -22,17 +57,46 @@ void EnableVTMode() {
     SetConsoleMode(hOut, dwMode);
 }
 #endif
-const int GRID_SIZE = 11; // -5 to +5
-const int HISTORY_LIMIT = 50; // max number of actions to display
+const int DEFAULT_WORLD_CELLS = 11; // -5 to +5
+const int MAX_WORLD_CELLS = 16385; // keeps the wire quantization step at or below 1/4 unit
+const int RENDER_VIEW_COLS = 41, RENDER_VIEW_ROWS = 21; // larger worlds are drawn through a viewport
+const int HISTORY_LIMIT = 50; // default number of actions kept for display
+const int DEFAULT_TICK_HZ = 60;
+const int RENDER_INTERVAL_MS = 300;
+const float DEFAULT_AOI_RADIUS = 4.0f; // area-of-interest radius for per-client replication
+
+enum class ActionKind : uint8_t { Move, Jump, Shoot, Count };
 
+const char* const ACTION_NAMES[] = { "Move", "Jump", "Shoot" };
+const char ACTION_GLYPHS[] = { 'M', 'J', 'S' };
+inline const char* actionName(ActionKind k) { return k < ActionKind::Count ? ACTION_NAMES[size_t(k)] : "?"; }
+
+const uint8_t ACTION_ILLEGAL = 1 << 0;
+const float DELTA_SCALE = 1024.0f; // deltas are fixed point, 1/1024 unit (range +-32)
+
+inline int16_t packDelta(float v) {
+    float q = std::round(v * DELTA_SCALE);
+    if (q > 32767.0f) q = 32767.0f;
+    if (q < -32768.0f) q = -32768.0f;
+    return int16_t(q);
+}
+inline float unpackDelta(int16_t v) { return float(v) / DELTA_SCALE; }
+
+// Trivially copyable so the queue, history and wire formats can memcpy it
 struct GameAction {
-    int clientID;
-    std::string type;
-    float dx, dy, dz;
-    int gx, gy;
-    bool illegal = false;
-    GameAction() : dx(0), dy(0), dz(0), gx(0), gy(0), illegal(false) {}
+    uint32_t clientID = 0;
+    ActionKind kind = ActionKind::Move;
+    uint8_t flags = 0;
+    int16_t dx = 0, dy = 0, dz = 0; // packed with packDelta
+    uint32_t seq = 0;               // per-client input sequence, starts at 1; the server acks the highest applied
+
+    bool illegal() const { return (flags & ACTION_ILLEGAL) != 0; }
+    float deltaX() const { return unpackDelta(dx); }
+    float deltaY() const { return unpackDelta(dy); }
+    float deltaZ() const { return unpackDelta(dz); }
 };
+static_assert(sizeof(GameAction) == 16, "GameAction must stay within 16 bytes");
+static_assert(std::is_trivially_copyable<GameAction>::value, "GameAction must be memcpy-able");
 
 template<typename T>
 class TSQueue {
@@ -43,192 +107,5429 @@ public:
     bool try_pop(T& out) { std::lock_guard<std::mutex> lock(mtx); if (q.empty()) return false; out = q.front(); q.pop(); return true; }
 };
 
-float getRandomFloat(float min, float max) {
-    static thread_local std::mt19937 gen(std::random_device{}());
+// What push() does when the ring is full
+enum class FullPolicy { Block, DropOldest, Reject };
+
+// Bounded lock-free multi-producer/single-consumer ring (Vyukov-style sequenced cells).
+// The dequeue side is CAS-based so DropOldest producers can evict the oldest entry safely.
+template<typename T>
+class MPSCRing {
+    struct Cell { std::atomic<size_t> seq; T data; };
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    FullPolicy policy;
+    alignas(64) std::atomic<size_t> head{ 0 }; // next enqueue position
+    alignas(64) std::atomic<size_t> tail{ 0 }; // next dequeue position
+    alignas(64) std::atomic<bool> closed{ false };
+    std::atomic<uint64_t> pushedCount{ 0 }, poppedCount{ 0 }, blockedCount{ 0 }, droppedCount{ 0 }, rejectedCount{ 0 };
+
+    bool evictOldest() { T dropped; return try_pop(dropped); }
+public:
+    struct Stats { uint64_t pushed, popped, blocked, droppedOldest, rejected; };
+
+    // capacity is rounded up to a power of two
+    explicit MPSCRing(size_t capacity, FullPolicy fullPolicy = FullPolicy::Block) { reset(capacity, fullPolicy); }
+
+    // Reinitializes an empty ring; only valid before any producer or consumer runs
+    void reset(size_t capacity, FullPolicy fullPolicy) {
+        size_t cap = 2;
+        while (cap < capacity) cap <<= 1;
+        cells.reset(new Cell[cap]);
+        for (size_t i = 0; i < cap; i++) cells[i].seq.store(i, std::memory_order_relaxed);
+        mask = cap - 1;
+        policy = fullPolicy;
+        head.store(0); tail.store(0); closed.store(false);
+    }
+    MPSCRing(const MPSCRing&) = delete;
+    MPSCRing& operator=(const MPSCRing&) = delete;
+
+    size_t capacity() const { return mask + 1; }
+    size_t size_approx() const {
+        size_t h = head.load(std::memory_order_relaxed), t = tail.load(std::memory_order_relaxed);
+        return h > t ? h - t : 0;
+    }
+    // Wakes any producer blocked on a full ring; further blocked pushes fail
+    void close() { closed.store(true, std::memory_order_release); }
+
+    bool push(const T& item) {
+        bool counted = false;
+        size_t pos = head.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[pos & mask];
+            size_t seq = cell.seq.load(std::memory_order_acquire);
+            intptr_t diff = intptr_t(seq) - intptr_t(pos);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            }
+            else if (diff < 0) {
+                // full
+                if (policy == FullPolicy::Reject) { rejectedCount.fetch_add(1, std::memory_order_relaxed); return false; }
+                if (policy == FullPolicy::DropOldest) {
+                    if (evictOldest()) droppedCount.fetch_add(1, std::memory_order_relaxed);
+                }
+                else {
+                    if (!counted) { blockedCount.fetch_add(1, std::memory_order_relaxed); counted = true; }
+                    if (closed.load(std::memory_order_acquire)) return false;
+                    std::this_thread::yield();
+                }
+                pos = head.load(std::memory_order_relaxed);
+            }
+            else pos = head.load(std::memory_order_relaxed);
+        }
+        Cell& cell = cells[pos & mask];
+        cell.data = item;
+        cell.seq.store(pos + 1, std::memory_order_release);
+        pushedCount.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool try_pop(T& out) { return try_pop_n(&out, 1) == 1; }
+
+    // Claims up to max ready entries with a single CAS on tail
+    size_t try_pop_n(T* out, size_t max) {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        size_t n;
+        for (;;) {
+            n = 0;
+            while (n < max && cells[(pos + n) & mask].seq.load(std::memory_order_acquire) == pos + n + 1) n++;
+            if (n == 0) return 0;
+            if (tail.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed)) break;
+        }
+        for (size_t i = 0; i < n; i++) {
+            Cell& cell = cells[(pos + i) & mask];
+            out[i] = cell.data;
+            cell.seq.store(pos + i + mask + 1, std::memory_order_release);
+        }
+        poppedCount.fetch_add(n, std::memory_order_relaxed);
+        return n;
+    }
+
+    Stats stats() const {
+        return { pushedCount.load(std::memory_order_relaxed), poppedCount.load(std::memory_order_relaxed),
+                 blockedCount.load(std::memory_order_relaxed), droppedCount.load(std::memory_order_relaxed),
+                 rejectedCount.load(std::memory_order_relaxed) };
+    }
+};
+
+inline int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Spin-wait hint: lets the sibling hyperthread run and saves power while polling
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+// Thread placement (--pin-*, --busy-poll). CPUs are OS CPU numbers, -1 leaves
+// a thread to the scheduler. There is no NUMA library: with pinned workers
+// each shard gets a home worker that first-touches its store and queues
+// (prefaultShards), and the kernel's default local-node policy then keeps
+// those pages on that worker's node.
+struct ThreadPlacement {
+    int server = -1, render = -1, io = -1; // io: checkpoint writer and stats exporter
+    std::vector<int> workers; // shard workers 1.. round-robin; worker 0 is the server thread
+    bool busyPoll = false;    // spin through idle time instead of sleeping
+    bool any() const { return server >= 0 || render >= 0 || io >= 0 || !workers.empty(); }
+};
+ThreadPlacement placement; // fixed before any thread starts
+std::atomic<uint32_t> threadsPinned{ 0 }, pinFailures{ 0 };
+
+// Pins the calling thread to cpu (no-op for -1); false when the OS refuses
+inline bool pinThisThread(int cpu) {
+    if (cpu < 0) return true;
+#ifdef HAVE_THREAD_AFFINITY
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (cpu < CPU_SETSIZE) {
+        CPU_SET(cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0) { threadsPinned.fetch_add(1); return true; }
+    }
+#endif
+    if (pinFailures.fetch_add(1) == 0) std::fprintf(stderr, "cannot pin a thread to CPU %d\n", cpu);
+    return false;
+}
+
+// World geometry: width x height unit cells centred on the origin. Both are
+// odd, so cell centres sit on integer coordinates and the world spans
+// |x| <= (width - 1) / 2, |y| <= (height - 1) / 2; grid row 0 is the top.
+// FixedWorld makes every bound and cell index a compile-time constant;
+// RuntimeWorld carries the same values for any other size. withWorld()
+// picks the specialization at the top of a hot loop.
+template<int W, int H>
+struct FixedWorld {
+    static_assert(W % 2 == 1 && H % 2 == 1, "world dimensions must be odd");
+    static constexpr int width() { return W; }
+    static constexpr int height() { return H; }
+    static constexpr float extentX() { return float(W / 2); }
+    static constexpr float extentY() { return float(H / 2); }
+};
+
+class RuntimeWorld {
+    int w, h;
+    float ex, ey;
+public:
+    RuntimeWorld(int cols, int rows) : w(cols), h(rows), ex(float(cols / 2)), ey(float(rows / 2)) {}
+    int width() const { return w; }
+    int height() const { return h; }
+    float extentX() const { return ex; }
+    float extentY() const { return ey; }
+};
+
+template<typename World>
+inline bool inWorld(const World& w, float x, float y) {
+    return !(x < -w.extentX() || x > w.extentX() || y < -w.extentY() || y > w.extentY());
+}
+// Grid cell of a position; outside the world when the position is
+template<typename World>
+inline int32_t worldCellX(const World& w, float x) { return int32_t(std::round(x) + w.extentX()); }
+template<typename World>
+inline int32_t worldCellY(const World& w, float y) { return int32_t(float(w.height() - 1) - (std::round(y) + w.extentY())); }
+
+RuntimeWorld world(DEFAULT_WORLD_CELLS, DEFAULT_WORLD_CELLS); // --world, fixed before any thread starts
+bool scatterSpawns = false; // --spawn scatter: new entities start on a cell hashed from their ID, not the origin
+
+// Where a new entity starts. Deterministic in the ID and world size, so a
+// replay places its joins exactly where the recorded run did
+inline void spawnPoint(uint32_t id, float& x, float& y) {
+    x = y = 0.0f;
+    if (!scatterSpawns) return;
+    uint32_t h = id * 2654435761u;
+    h ^= h >> 15;
+    h *= 2246822519u;
+    h ^= h >> 13;
+    x = float(int32_t(h % uint32_t(world.width()))) - world.extentX();
+    y = float(int32_t((h >> 16) % uint32_t(world.height()))) - world.extentY();
+}
+
+template<typename Fn>
+inline void withWorld(Fn&& fn) {
+    int w = world.width(), h = world.height();
+    if (w == 11 && h == 11) fn(FixedWorld<11, 11>());
+    else if (w == 257 && h == 257) fn(FixedWorld<257, 257>());
+    else if (w == 1025 && h == 1025) fn(FixedWorld<1025, 1025>());
+    else if (w == 4097 && h == 4097) fn(FixedWorld<4097, 4097>());
+    else fn(world);
+}
+
+uint32_t rngSeed = 0; // --seed; 0 seeds every client from std::random_device
+
+// Clients draw from their own generator, so with a fixed seed each client's
+// action stream is reproducible regardless of thread scheduling. Client
+// threads use mt19937; pooled clients a minstd_rand, 5 KB smaller apiece.
+template <typename Rng = std::mt19937>
+Rng makeClientRng(uint32_t clientID) {
+    return Rng(rngSeed ? rngSeed * 2654435761u + clientID : std::random_device{}());
+}
+template <typename Rng>
+float getRandomFloat(Rng& gen, float min, float max) {
     std::uniform_real_distribution<float> dist(min, max);
     return dist(gen);
 }
 
-// Shared resources
-TSQueue<GameAction> actionQueue;
-std::mutex stateMutex;
-std::map<int, std::tuple<float, float, float>> serverState;
-std::map<int, std::tuple<float, float, float>> clientPredicted;
-std::vector<GameAction> actionHistory;
-std::map<int, int> penalties;
-bool done = false;
+// Single-producer/single-consumer triple buffer. The writer fills writeSlot()
+// and publish()es it; the reader picks up the newest published slot with
+// update(). Neither side ever waits for the other.
+template<typename T>
+class TripleBuffer {
+    static const uint32_t FRESH = 4;
+    T slots[3];
+    std::atomic<uint32_t> middle{ 1 }; // slot index, plus FRESH when unread
+    uint32_t writeIdx = 0, readIdx = 2;
+public:
+    T& writeSlot() { return slots[writeIdx]; }
+    void publish() { writeIdx = middle.exchange(writeIdx | FRESH, std::memory_order_acq_rel) & 3; }
+    // Returns true if a newer slot was published since the last call
+    bool update() {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH)) return false;
+        readIdx = middle.exchange(readIdx, std::memory_order_acq_rel) & 3;
+        return true;
+    }
+    const T& readSlot() const { return slots[readIdx]; }
+};
 
-bool validateAction(GameAction& a) {
-    float x = std::get<0>(serverState[a.clientID]);
-    float y = std::get<1>(serverState[a.clientID]);
+// Fixed-capacity circular buffer: O(1) append, the oldest entry is overwritten
+// once full. Indexing and iteration run oldest to newest.
+template<typename T>
+class HistoryRing {
+    std::vector<T> buf;
+    size_t start = 0, count = 0;
 
-    float nx = x, ny = y;
-    if (a.type == "Move") { nx += a.dx; ny += a.dy; }
+    size_t wrap(size_t i) const { return i >= buf.size() ? i - buf.size() : i; } // i < 2 * capacity
+public:
+    explicit HistoryRing(size_t capacity) : buf(capacity ? capacity : 1) {}
 
-    int gx = std::round(nx) + 5;
-    int gy = GRID_SIZE - 1 - (std::round(ny) + 5);
-    a.gx = gx; a.gy = gy;
+    // Drops all entries; capacity is set at runtime, e.g. for long replay-debugging histories
+    void reset(size_t capacity) { buf.assign(capacity ? capacity : 1, T()); start = count = 0; }
+    void clear() { start = count = 0; }
 
-    if (nx < -5.0f || nx>5.0f || ny < -5.0f || ny>5.0f) {
-        a.illegal = true;
-        return false;
+    void push_back(const T& item) {
+        if (count < buf.size()) { buf[wrap(start + count)] = item; count++; }
+        else { buf[start] = item; start = wrap(start + 1); }
     }
-    return true;
+
+    size_t size() const { return count; }
+    size_t capacity() const { return buf.size(); }
+    bool empty() const { return count == 0; }
+    const T& operator[](size_t i) const { return buf[wrap(start + i)]; }
+    const T& back() const { return (*this)[count - 1]; }
+
+    class const_iterator {
+        const HistoryRing* ring;
+        size_t i;
+    public:
+        const_iterator(const HistoryRing* r, size_t idx) : ring(r), i(idx) {}
+        const T& operator*() const { return (*ring)[i]; }
+        const T* operator->() const { return &(*ring)[i]; }
+        const_iterator& operator++() { i++; return *this; }
+        bool operator!=(const const_iterator& o) const { return i != o.i; }
+        bool operator==(const const_iterator& o) const { return i == o.i; }
+    };
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, count); }
+};
+
+// Log-linear latency histogram: 2^SUB_BITS linear buckets per power of two,
+// so any recorded value is reported within ~1.5% without storing samples.
+class LatencyHistogram {
+    static const int SUB_BITS = 6;
+    static const int SUB = 1 << SUB_BITS;
+    static const int MAGNITUDES = 48;
+    std::vector<uint64_t> buckets;
+    uint64_t total = 0;
+    int64_t maxValue = 0;
+
+    static uint64_t valueOf(size_t b) { // upper edge of bucket b
+        if (b < size_t(SUB)) return b;
+        int shift = int(b / SUB) - 1;
+        return ((uint64_t(b % SUB) + SUB + 1) << shift) - 1;
+    }
+public:
+    static const size_t BUCKETS = size_t(MAGNITUDES) * SUB;
+    // Clamped to the last bucket
+    static size_t bucketOf(uint64_t v) {
+        if (v < uint64_t(SUB)) return size_t(v);
+        int msb = 63;
+        while (!(v >> msb)) msb--;
+        int shift = msb - SUB_BITS;
+        return std::min(size_t(shift + 1) * SUB + size_t((v >> shift) - SUB), BUCKETS - 1);
+    }
+
+    LatencyHistogram() : buckets(BUCKETS, 0) {}
+
+    void record(int64_t v) {
+        if (v < 0) v = 0;
+        buckets[bucketOf(uint64_t(v))]++;
+        total++;
+        if (v > maxValue) maxValue = v;
+    }
+    // Folds in counts kept elsewhere in the same bucket layout
+    void addBucket(size_t b, uint64_t n) { buckets[b] += n; total += n; }
+    void noteMax(int64_t v) { if (v > maxValue) maxValue = v; }
+    void merge(const LatencyHistogram& o) {
+        for (size_t i = 0; i < buckets.size(); i++) buckets[i] += o.buckets[i];
+        total += o.total;
+        if (o.maxValue > maxValue) maxValue = o.maxValue;
+    }
+    void clear() { std::fill(buckets.begin(), buckets.end(), 0); total = 0; maxValue = 0; }
+    uint64_t count() const { return total; }
+    int64_t max() const { return maxValue; }
+    // q in [0, 1]
+    int64_t percentile(double q) const {
+        if (total == 0) return 0;
+        uint64_t rank = uint64_t(std::ceil(q * double(total)));
+        if (rank == 0) rank = 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < buckets.size(); i++) {
+            seen += buckets[i];
+            if (seen >= rank) return std::min<int64_t>(int64_t(valueOf(i)), maxValue);
+        }
+        return maxValue;
+    }
+};
+
+// Monotonic bump allocator for data that lives at most one tick: alloc() never
+// frees, reset() rewinds to empty. A tick that outgrows the block spills into
+// extra heap blocks, and the next reset() swaps them for one block big enough
+// for that tick, so a steady workload stops touching the heap.
+class TickArena {
+    static const size_t ALIGN = 32; // enough for aligned AVX access to any allocation
+    std::unique_ptr<uint8_t[]> block;
+    size_t capacity = 0, used = 0;
+    std::vector<std::unique_ptr<uint8_t[]>> overflow;
+    size_t overflowBytes = 0;
+    uint64_t resets = 0, grows = 0;
+    size_t peak = 0;
+
+    static uint8_t* alignUp(uint8_t* p) { return reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(p) + ALIGN - 1) & ~uintptr_t(ALIGN - 1)); }
+public:
+    struct Stats { uint64_t resets, grows; size_t peakBytes, capacity; };
+
+    explicit TickArena(size_t bytes = 0) : block(bytes ? new uint8_t[bytes + ALIGN] : nullptr), capacity(bytes) {}
+
+    // Uninitialized storage for n T's, valid until the next reset()
+    template<typename T>
+    T* alloc(size_t n) {
+        static_assert(std::is_trivially_destructible<T>::value, "arena memory is released without destructors");
+        size_t bytes = (n * sizeof(T) + ALIGN - 1) & ~(ALIGN - 1);
+        if (used + bytes <= capacity) {
+            uint8_t* p = alignUp(block.get()) + used;
+            used += bytes;
+            return reinterpret_cast<T*>(p);
+        }
+        overflow.emplace_back(new uint8_t[bytes + ALIGN]);
+        overflowBytes += bytes;
+        grows++;
+        return reinterpret_cast<T*>(alignUp(overflow.back().get()));
+    }
+    void reset() {
+        size_t need = used + overflowBytes;
+        if (need > peak) peak = need;
+        if (!overflow.empty()) {
+            overflow.clear();
+            capacity = need + need / 2;
+            block.reset(new uint8_t[capacity + ALIGN]);
+        }
+        used = overflowBytes = 0;
+        resets++;
+    }
+    Stats stats() const { return { resets, grows, peak, capacity }; }
+    // Writes the whole block, so its pages belong to the calling thread's NUMA node
+    void prefault() { if (block) std::memset(block.get(), 0, capacity + ALIGN); }
+};
+
+// Hot-path instrumentation: per-stage scoped timers feeding log-linear
+// histograms, plus event counters. Every thread owns one ThreadStats block and
+// is its only writer, so updates are relaxed load+store pairs with no locked
+// instructions or shared cache lines; the exporter reads all blocks with
+// relaxed loads. Build with -DAE_INSTRUMENT=0 to compile all of it out.
+#ifndef AE_INSTRUMENT
+#define AE_INSTRUMENT 1
+#endif
+
+// Heap allocations made by the calling thread, counted by the global operator
+// new below so tick code can check it stays off the heap. The replacement is
+// instrumentation too: uninstrumented builds keep the system allocator and
+// the count stays at zero.
+thread_local uint64_t heapAllocCount = 0;
+#if AE_INSTRUMENT
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete" // malloc/free pairing is deliberate here
+#endif
+void* operator new(std::size_t n) {
+    heapAllocCount++;
+    if (void* p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
 }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
 
-const std::string RESET = "\033[0m";
-const std::string RED = "\033[31m";
-const std::string GREEN = "\033[32m";
-const std::string YELLOW = "\033[33m";
-const std::string MAGENTA = "\033[35m";
-const std::string CYAN = "\033[36m";
-const std::string GRAY = "\033[90m"; // oldest actions
+enum class Stage : uint8_t { Drain, Validate, Apply, History, Broadcast, Render, Tick, Count };
+const char* const STAGE_NAMES[] = { "queue_drain", "validate", "apply", "history", "broadcast", "render", "tick" };
+enum class Counter : uint8_t { ActionsDrained, ActionsValidated, ActionsRejected, SnapshotsSent, RenderFrames, ClientInputs, Count };
+const char* const COUNTER_NAMES[] = { "actions_drained", "actions_validated", "actions_rejected", "snapshots_sent", "render_frames", "client_inputs" };
 
-//Server
-void serverThread(const std::vector<int>& clientIDs, int latencyMs = 100) {
-    std::cout << "\033[?25l"; // hide cursor
+#if AE_INSTRUMENT
+class ThreadStats {
+public:
+    struct StageHist {
+        std::atomic<uint64_t> count{ 0 }, sumNs{ 0 }, maxNs{ 0 };
+        std::atomic<uint64_t> buckets[LatencyHistogram::BUCKETS];
+        StageHist() { for (auto& b : buckets) b.store(0, std::memory_order_relaxed); }
+    };
+    std::atomic<uint64_t> counters[size_t(Counter::Count)];
+    // Histograms are ~24 KiB each, so a thread only gets the stages it times
+    std::atomic<StageHist*> stages[size_t(Stage::Count)];
 
-    while (!done) {
-        GameAction action;
-        while (actionQueue.try_pop(action)) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(latencyMs));
+    ThreadStats() {
+        for (auto& c : counters) c.store(0, std::memory_order_relaxed);
+        for (auto& h : stages) h.store(nullptr, std::memory_order_relaxed);
+    }
+    ~ThreadStats() { for (auto& h : stages) delete h.load(std::memory_order_relaxed); }
+    static void bump(std::atomic<uint64_t>& a, uint64_t n) { a.store(a.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
 
-            std::lock_guard<std::mutex> lock(stateMutex);
-            bool legal = validateAction(action);
+    void count(Counter c, uint64_t n) { bump(counters[size_t(c)], n); }
+    StageHist& hist(Stage s) {
+        StageHist* h = stages[size_t(s)].load(std::memory_order_relaxed);
+        if (!h) { h = new StageHist(); stages[size_t(s)].store(h, std::memory_order_release); }
+        return *h;
+    }
+    void record(Stage s, uint64_t ns) {
+        StageHist* h = &hist(s);
+        bump(h->count, 1);
+        bump(h->sumNs, ns);
+        if (ns > h->maxNs.load(std::memory_order_relaxed)) h->maxNs.store(ns, std::memory_order_relaxed);
+        bump(h->buckets[LatencyHistogram::bucketOf(ns)], 1);
+    }
+};
 
-            if (legal) {
-                auto& pos = serverState[action.clientID];
-                float x = std::get<0>(pos);
-                float y = std::get<1>(pos);
-                if (action.type == "Move") { x += action.dx; y += action.dy; }
-                pos = std::make_tuple(x, y, 0);
-            }
-            else {
-                penalties[action.clientID]++;
+// Blocks outlive their threads, so totals survive client and worker exits
+std::mutex threadStatsMutex;
+std::vector<std::unique_ptr<ThreadStats>> threadStatsBlocks;
+thread_local ThreadStats* localStats = nullptr;
+
+inline ThreadStats& threadStats() {
+    if (!localStats) {
+        std::lock_guard<std::mutex> lock(threadStatsMutex);
+        threadStatsBlocks.emplace_back(new ThreadStats());
+        localStats = threadStatsBlocks.back().get();
+    }
+    return *localStats;
+}
+
+// Allocates the calling thread's block and the histograms for the stages it
+// will time. Threads on the tick path call it when they start, so the first
+// time a stage is timed doesn't count as a heap allocation in a steady tick.
+inline void prepareThreadStats(std::initializer_list<Stage> timed) {
+    ThreadStats& ts = threadStats();
+    for (Stage s : timed) ts.hist(s);
+}
+
+class ScopedStageTimer {
+    ThreadStats& stats;
+    Stage stage;
+    int64_t start;
+public:
+    ScopedStageTimer(ThreadStats& ts, Stage s) : stats(ts), stage(s), start(nowNs()) {}
+    ~ScopedStageTimer() { stats.record(stage, uint64_t(nowNs() - start)); }
+    ScopedStageTimer(const ScopedStageTimer&) = delete;
+    ScopedStageTimer& operator=(const ScopedStageTimer&) = delete;
+};
+
+#define STAGE_TIMER_NAME2(line) stageTimer_##line
+#define STAGE_TIMER_NAME(line) STAGE_TIMER_NAME2(line)
+// Times the rest of the enclosing scope
+#define STAGE_TIMER(s) ScopedStageTimer STAGE_TIMER_NAME(__LINE__)(threadStats(), s)
+#define STAT_COUNT(c, n) threadStats().count(c, uint64_t(n))
+#else
+#define STAGE_TIMER(s) ((void)0)
+#define STAT_COUNT(c, n) ((void)0)
+inline void prepareThreadStats(std::initializer_list<Stage>) {}
+#endif
+
+const uint32_t NO_ENTITY = UINT32_MAX;
+
+// Per-client anti-cheat state kept by the rule engine. Windows are counted in
+// ticks, so a replay reaches the same verdicts as the live run.
+struct RuleState {
+    uint32_t windowTick = 0;       // first tick of the current rate window
+    uint16_t windowActions = 0;    // actions received in it, accepted or not
+    uint16_t windowShoots = 0;
+    uint16_t windowPenalties = 0;  // rejections in it, counted toward a throttle
+    uint8_t strikes = 0;           // throttles so far; enough of them is a kick
+    uint8_t kicked = 0;
+    uint32_t lastJumpTick = 0;     // tick of the last accepted jump, plus one (0 = never)
+    uint32_t throttledUntil = 0;   // actions are dropped before this tick
+    uint32_t speedTick = 0;        // tick that moved accumulates over
+    float moved = 0.0f;            // distance moved so far in speedTick
+};
+static_assert(std::is_trivially_copyable<RuleState>::value && sizeof(RuleState) == 28, "RuleState is checkpointed raw");
+
+// One entity's simulated state, as moved between stores
+struct EntityRecord {
+    uint32_t id;
+    float x, y, z, vz;
+    int32_t penalty;
+    uint32_t lastInput;
+    RuleState rules;
+    uint32_t timesHit;
+};
+
+// Dense structure-of-arrays entity storage keyed by client ID.
+// Lookup is a direct index through slotOf. remove() only marks the entity dead;
+// the swap-and-pop compaction is deferred to flushRemovals() so index loops over
+// [0, size()) stay valid while entities come and go.
+// markDirty() records which entities changed during the current tick so the
+// snapshot publish only has to visit those.
+class EntityStore {
+    std::vector<uint32_t> slotOf; // client ID -> dense index
+    std::vector<uint32_t> removed;
+
+    void moveSlot(uint32_t dst, uint32_t src) {
+        ids[dst] = ids[src]; x[dst] = x[src]; y[dst] = y[src]; z[dst] = z[src]; vz[dst] = vz[src];
+        penalty[dst] = penalty[src]; alive[dst] = alive[src]; isDirty[dst] = isDirty[src]; version[dst] = version[src];
+        lastInput[dst] = lastInput[src]; rules[dst] = rules[src]; timesHit[dst] = timesHit[src];
+        slotOf[ids[dst]] = dst;
+    }
+    void popSlot() {
+        ids.pop_back(); x.pop_back(); y.pop_back(); z.pop_back(); vz.pop_back();
+        penalty.pop_back(); alive.pop_back(); isDirty.pop_back(); version.pop_back();
+        lastInput.pop_back(); rules.pop_back(); timesHit.pop_back();
+    }
+public:
+    std::vector<uint32_t> ids;
+    std::vector<float> x, y, z;
+    std::vector<float> vz; // vertical velocity in units per tick, 0 on the ground
+    std::vector<int32_t> penalty;
+    std::vector<uint8_t> alive;
+    std::vector<uint8_t> isDirty;
+    std::vector<uint64_t> version; // snapshot version in which the entity last changed
+    std::vector<uint32_t> lastInput; // highest input seq applied to the entity, 0 = none
+    std::vector<RuleState> rules;
+    std::vector<uint32_t> timesHit; // shots that have hit the entity
+    std::vector<uint32_t> dirty;   // indices marked since the last clearDirty()
+
+    size_t size() const { return ids.size(); }
+    size_t capacity() const { return ids.capacity(); }
+    // Makes room for n entities with IDs below idLimit, so add() won't allocate
+    void reserve(size_t n, uint32_t idLimit) {
+        ids.reserve(n); x.reserve(n); y.reserve(n); z.reserve(n); vz.reserve(n); penalty.reserve(n);
+        alive.reserve(n); isDirty.reserve(n); version.reserve(n); lastInput.reserve(n); rules.reserve(n); timesHit.reserve(n);
+        dirty.reserve(n); removed.reserve(n);
+        if (idLimit > slotOf.size()) slotOf.resize(idLimit, NO_ENTITY);
+    }
+    uint32_t indexOf(uint32_t id) const { return id < slotOf.size() ? slotOf[id] : NO_ENTITY; }
+    // Writes every reserved slot once, so the pages are faulted in by (and, on
+    // a NUMA host, allocated next to) the calling thread
+    void prefault() {
+        touch(ids); touch(x); touch(y); touch(z); touch(vz); touch(penalty); touch(alive); touch(isDirty); touch(version);
+        touch(lastInput); touch(rules); touch(timesHit); touch(dirty); touch(removed); touch(slotOf);
+    }
+    template<typename T>
+    static void touch(std::vector<T>& v) { size_t n = v.size(); v.resize(v.capacity()); v.resize(n); }
+
+    // Returns the existing index, or appends a new entity at the origin
+    uint32_t add(uint32_t id) {
+        uint32_t idx = indexOf(id);
+        if (idx != NO_ENTITY) {
+            if (!alive[idx]) {
+                alive[idx] = 1;
+                x[idx] = y[idx] = z[idx] = vz[idx] = 0.0f; penalty[idx] = 0; lastInput[idx] = 0; rules[idx] = RuleState(); timesHit[idx] = 0;
+                markDirty(idx);
+                for (size_t i = 0; i < removed.size(); i++) if (removed[i] == id) { removed[i] = removed.back(); removed.pop_back(); break; }
             }
+            return idx;
+        }
+        if (id >= slotOf.size()) slotOf.resize(size_t(id) + 1, NO_ENTITY);
+        idx = uint32_t(ids.size());
+        slotOf[id] = idx;
+        ids.push_back(id);
+        x.push_back(0.0f); y.push_back(0.0f); z.push_back(0.0f); vz.push_back(0.0f);
+        penalty.push_back(0);
+        alive.push_back(1);
+        isDirty.push_back(0);
+        version.push_back(0);
+        lastInput.push_back(0);
+        rules.push_back(RuleState());
+        timesHit.push_back(0);
+        markDirty(idx);
+        return idx;
+    }
+    EntityRecord record(uint32_t idx) const { return { ids[idx], x[idx], y[idx], z[idx], vz[idx], penalty[idx], lastInput[idx], rules[idx], timesHit[idx] }; }
+    // Adds or overwrites the entity and marks it dirty
+    uint32_t put(const EntityRecord& r) {
+        uint32_t idx = add(r.id);
+        x[idx] = r.x; y[idx] = r.y; z[idx] = r.z; vz[idx] = r.vz; penalty[idx] = r.penalty; lastInput[idx] = r.lastInput; rules[idx] = r.rules; timesHit[idx] = r.timesHit;
+        markDirty(idx);
+        return idx;
+    }
+    void markDirty(uint32_t idx) {
+        if (isDirty[idx]) return;
+        isDirty[idx] = 1;
+        dirty.push_back(idx);
+    }
+    void clearDirty() {
+        for (uint32_t idx : dirty) isDirty[idx] = 0;
+        dirty.clear();
+    }
+    void remove(uint32_t id) {
+        uint32_t idx = indexOf(id);
+        if (idx == NO_ENTITY || !alive[idx]) return;
+        alive[idx] = 0;
+        markDirty(idx);
+        removed.push_back(id);
+    }
+    // Like remove(), but the slot is kept, for a store whose dense indices
+    // something else is keyed by; add() or put() brings the entity back there
+    void retire(uint32_t idx) {
+        if (!alive[idx]) return;
+        alive[idx] = 0;
+        markDirty(idx);
+    }
+    // Compacts removed entities. Dense indices change, so call it only after
+    // the tick's dirty list has been consumed.
+    void flushRemovals() {
+        clearDirty();
+        for (uint32_t id : removed) {
+            uint32_t idx = slotOf[id];
+            uint32_t last = uint32_t(ids.size() - 1);
+            if (idx != last) moveSlot(idx, last);
+            popSlot();
+            slotOf[id] = NO_ENTITY;
+        }
+        removed.clear();
+    }
+};
 
-            // Add to history
-            actionHistory.push_back(action);
-            if (actionHistory.size() > HISTORY_LIMIT) actionHistory.erase(actionHistory.begin());
+// Uniform grid spatial index over world-space positions, keyed by client ID.
+// Each cell holds an intrusive doubly linked list, so insert/move/remove are
+// O(1); range and nearest-neighbour queries only visit overlapping cells.
+// Positions outside the grid clamp into the border cells.
+class SpatialGrid {
+    float minX, minY, invCell, cellSize;
+    int cols, rows;
+    std::vector<uint32_t> cellHead;       // first entity ID in each cell
+    std::vector<uint32_t> next, prev;     // per-ID list links
+    std::vector<uint32_t> cellOf;         // per-ID cell, NO_ENTITY when absent
+    std::vector<float> px, py;            // per-ID position as last indexed
+    size_t count = 0;
+
+    void link(uint32_t id, uint32_t cell) {
+        prev[id] = NO_ENTITY;
+        next[id] = cellHead[cell];
+        if (cellHead[cell] != NO_ENTITY) prev[cellHead[cell]] = id;
+        cellHead[cell] = id;
+        cellOf[id] = cell;
+    }
+    void unlink(uint32_t id) {
+        uint32_t cell = cellOf[id];
+        if (prev[id] != NO_ENTITY) next[prev[id]] = next[id];
+        else cellHead[cell] = next[id];
+        if (next[id] != NO_ENTITY) prev[next[id]] = prev[id];
+        cellOf[id] = NO_ENTITY;
+    }
+public:
+    SpatialGrid(float originX, float originY, float cell, int numCols, int numRows)
+        : minX(originX), minY(originY), invCell(1.0f / cell), cellSize(cell), cols(numCols), rows(numRows),
+          cellHead(size_t(numCols) * numRows, NO_ENTITY) {}
+
+    int cellX(float x) const { int c = int(std::floor((x - minX) * invCell)); return c < 0 ? 0 : c >= cols ? cols - 1 : c; }
+    int cellY(float y) const { int c = int(std::floor((y - minY) * invCell)); return c < 0 ? 0 : c >= rows ? rows - 1 : c; }
+    uint32_t cellIndex(float x, float y) const { return uint32_t(cellY(y) * cols + cellX(x)); }
+    size_t size() const { return count; }
+    bool contains(uint32_t id) const { return id < cellOf.size() && cellOf[id] != NO_ENTITY; }
 
-            // Update client predicted positions
-            for (int id : clientIDs) clientPredicted[id] = serverState[id];
+    // Inserts or moves an entity; only touches the lists if its cell changed
+    void update(uint32_t id, float x, float y) {
+        if (id >= cellOf.size()) {
+            size_t n = size_t(id) + 1;
+            next.resize(n, NO_ENTITY); prev.resize(n, NO_ENTITY); cellOf.resize(n, NO_ENTITY);
+            px.resize(n, 0.0f); py.resize(n, 0.0f);
         }
+        uint32_t cell = cellIndex(x, y);
+        px[id] = x; py[id] = y;
+        if (cellOf[id] == cell) return;
+        if (cellOf[id] != NO_ENTITY) unlink(id);
+        else count++;
+        link(id, cell);
+    }
+    void remove(uint32_t id) {
+        if (!contains(id)) return;
+        unlink(id);
+        count--;
+    }
 
-        // Draw ASCII grid
-        std::vector<std::string> grid(GRID_SIZE * GRID_SIZE, ".");
+    template<typename Fn>
+    void forEachInCell(int cx, int cy, Fn fn) const {
+        for (uint32_t id = cellHead[size_t(cy) * cols + cx]; id != NO_ENTITY; id = next[id]) fn(id, px[id], py[id]);
+    }
 
-        {
-            int historySize = actionHistory.size();
-            for (int i = 0; i < historySize; i++) {
-                auto& act = actionHistory[i];
-                int idx = act.gy * GRID_SIZE + act.gx;
-                if (idx < 0 || idx >= GRID_SIZE * GRID_SIZE) continue;
-
-                // Determine fade level
-                float age = float(historySize - i) / historySize;
-                std::string color;
-                if (act.illegal) color = MAGENTA;
-                else if (act.type == "Move") color = GREEN;
-                else if (act.type == "Jump") color = YELLOW;
-                else if (act.type == "Shoot") color = RED;
-
-                if (age < 0.33f) color = GRAY;       // oldest
-                else if (age < 0.66f) color = "\033[2m" + color; // medium dim
-                // else bright for recent
-
-                if (act.illegal) grid[idx] = color + "X" + RESET;
-                else if (act.type == "Move") grid[idx] = color + "M" + RESET;
-                else if (act.type == "Jump") grid[idx] = color + "J" + RESET;
-                else if (act.type == "Shoot") grid[idx] = color + "S" + RESET;
-            }
-
-            // Highlight current client positions
-            for (auto& kv : clientPredicted) {
-                int id = kv.first;
-                float fx = std::get<0>(kv.second);
-                float fy = std::get<1>(kv.second);
-                int gx = std::round(fx) + 5;
-                int gy = GRID_SIZE - 1 - (std::round(fy) + 5);
-                int idx = gy * GRID_SIZE + gx;
-                if (idx >= 0 && idx < GRID_SIZE * GRID_SIZE) {
-                    grid[idx] = CYAN + std::to_string(id) + RESET;
+    // Calls fn(id, x, y) for every entity within radius of (x, y)
+    template<typename Fn>
+    void forEachInRange(float x, float y, float radius, Fn fn) const {
+        int x0 = cellX(x - radius), x1 = cellX(x + radius);
+        int y0 = cellY(y - radius), y1 = cellY(y + radius);
+        float r2 = radius * radius;
+        for (int cy = y0; cy <= y1; cy++)
+            for (int cx = x0; cx <= x1; cx++)
+                forEachInCell(cx, cy, [&](uint32_t id, float ex, float ey) {
+                    float ddx = ex - x, ddy = ey - y;
+                    if (ddx * ddx + ddy * ddy <= r2) fn(id, ex, ey);
+                });
+    }
+
+    // Closest entity to (x, y) other than exclude, searching rings of cells
+    // outward; NO_ENTITY if nothing lies within maxRadius
+    uint32_t nearest(float x, float y, float maxRadius, uint32_t exclude = NO_ENTITY) const {
+        int ccx = cellX(x), ccy = cellY(y);
+        int maxRing = int(std::ceil(maxRadius * invCell)) + 1;
+        uint32_t best = NO_ENTITY;
+        float bestD2 = maxRadius * maxRadius;
+        auto visit = [&](uint32_t id, float ex, float ey) {
+            if (id == exclude) return;
+            float ddx = ex - x, ddy = ey - y, d2 = ddx * ddx + ddy * ddy;
+            if (d2 <= bestD2) { bestD2 = d2; best = id; }
+        };
+        for (int ring = 0; ring <= maxRing; ring++) {
+            // Anything in this ring is at least (ring - 1) cells away
+            if (best != NO_ENTITY && float(ring - 1) * cellSize > std::sqrt(bestD2)) break;
+            for (int cy = ccy - ring; cy <= ccy + ring; cy++) {
+                if (cy < 0 || cy >= rows) continue;
+                bool edgeRow = cy == ccy - ring || cy == ccy + ring;
+                for (int cx = ccx - ring; cx <= ccx + ring; cx += (edgeRow || ring == 0) ? 1 : 2 * ring) {
+                    if (cx >= 0 && cx < cols) forEachInCell(cx, cy, visit);
                 }
             }
         }
+        return best;
+    }
+};
 
-        // Move cursor to top-left
-        std::cout << "\033[H";
-        std::cout << "=== ASCII Game Map (Live) ===\n";
-        for (int y = 0; y < GRID_SIZE; y++) {
-            for (int x = 0; x < GRID_SIZE; x++) {
-                std::cout << grid[y * GRID_SIZE + x] << " ";
-            }
-            std::cout << "\n";
+// Snapshot wire format. Positions are quantized to 16-bit fixed point over
+// the known world bounds, entities are sent sorted by ID with gap-coded IDs,
+// a bit-packed "changed" flag per entity, and zigzag varint deltas against the
+// baseline snapshot the client last acknowledged (absolute values for
+// entities the baseline doesn't have). Encode and decode never allocate.
+//
+//   u8 version | varint seq | varint baseSeq (0 = none) | varint count
+//   count x varint idGap | ceil(count / 8) flag bytes | per changed entity 3 x zigzag varint
+const uint8_t WIRE_VERSION = 1;
+const float Z_EXTENT = 8.0f;
+const float QUANT_MAX = 32767.0f;
+// x and y share one scale, so the wire only depends on the larger world axis
+inline float quantExtent() { return std::max(world.extentX(), world.extentY()); }
+
+struct QuantEntity {
+    uint32_t id;
+    int16_t x, y, z;
+    bool sameState(const QuantEntity& o) const { return x == o.x && y == o.y && z == o.z; }
+};
+
+inline int16_t quantize(float v, float extent) {
+    float q = std::round(v / extent * QUANT_MAX);
+    return int16_t(q > QUANT_MAX ? QUANT_MAX : q < -QUANT_MAX ? -QUANT_MAX : q);
+}
+inline float dequantize(int16_t q, float extent) { return float(q) / QUANT_MAX * extent; }
+inline QuantEntity quantizeEntity(uint32_t id, float x, float y, float z) {
+    float e = quantExtent();
+    return { id, quantize(x, e), quantize(y, e), quantize(z, Z_EXTENT) };
+}
+
+// A sorted-by-ID entity array, owned elsewhere
+struct SnapshotSpan {
+    uint32_t seq;
+    const QuantEntity* ents;
+    uint32_t count;
+};
+
+class ByteWriter {
+    uint8_t* p;
+    uint8_t* end;
+    bool overflow = false;
+public:
+    uint8_t* const begin;
+    ByteWriter(uint8_t* buf, size_t cap) : p(buf), end(buf + cap), begin(buf) {}
+    void put(uint8_t b) { if (p < end) *p++ = b; else overflow = true; }
+    void varint(uint32_t v) { while (v >= 0x80) { put(uint8_t(v | 0x80)); v >>= 7; } put(uint8_t(v)); }
+    void zigzag(int32_t v) { varint((uint32_t(v) << 1) ^ uint32_t(v >> 31)); }
+    uint8_t* reserve(size_t n) { if (size_t(end - p) < n) { overflow = true; return nullptr; } uint8_t* r = p; p += n; return r; }
+    bool ok() const { return !overflow; }
+    size_t size() const { return size_t(p - begin); }
+};
+
+class ByteReader {
+    const uint8_t* p;
+    const uint8_t* end;
+    bool bad = false;
+public:
+    ByteReader(const uint8_t* buf, size_t n) : p(buf), end(buf + n) {}
+    uint8_t get() { if (p < end) return *p++; bad = true; return 0; }
+    uint32_t varint() {
+        uint32_t v = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            uint8_t b = get();
+            v |= uint32_t(b & 0x7F) << shift;
+            if (!(b & 0x80)) return v;
         }
-        std::cout << "\nPenalties: ";
-        for (auto& p : penalties) std::cout << "Client " << p.first << "=" << p.second << " ";
-        std::cout << "\n" << std::flush;
+        bad = true;
+        return 0;
+    }
+    int32_t zigzag() { uint32_t v = varint(); return int32_t(v >> 1) ^ -int32_t(v & 1); }
+    const uint8_t* take(size_t n) { if (size_t(end - p) < n) { bad = true; return nullptr; } const uint8_t* r = p; p += n; return r; }
+    bool ok() const { return !bad; }
+};
+
+// Encodes cur against base (base may be null for a full snapshot). Returns the
+// encoded size, or 0 if out is too small. changedOut receives the number of
+// entities whose state was sent.
+size_t encodeSnapshot(const SnapshotSpan& cur, const SnapshotSpan* base, uint8_t* out, size_t cap, uint32_t* changedOut = nullptr) {
+    ByteWriter w(out, cap);
+    w.put(WIRE_VERSION);
+    w.varint(cur.seq);
+    w.varint(base ? base->seq : 0);
+    w.varint(cur.count);
+    uint32_t prevId = 0;
+    for (uint32_t i = 0; i < cur.count; i++) { w.varint(cur.ents[i].id - prevId); prevId = cur.ents[i].id; }
 
-        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    uint8_t* flags = w.reserve((cur.count + 7) / 8);
+    if (!flags) return 0;
+    std::memset(flags, 0, (cur.count + 7) / 8);
+    uint32_t changed = 0, b = 0;
+    for (uint32_t i = 0; i < cur.count; i++) {
+        const QuantEntity& e = cur.ents[i];
+        while (base && b < base->count && base->ents[b].id < e.id) b++;
+        const QuantEntity* prev = (base && b < base->count && base->ents[b].id == e.id) ? &base->ents[b] : nullptr;
+        if (prev && prev->sameState(e)) continue;
+        flags[i >> 3] |= uint8_t(1 << (i & 7));
+        changed++;
+        w.zigzag(int32_t(e.x) - (prev ? prev->x : 0));
+        w.zigzag(int32_t(e.y) - (prev ? prev->y : 0));
+        w.zigzag(int32_t(e.z) - (prev ? prev->z : 0));
     }
+    if (changedOut) *changedOut = changed;
+    return w.ok() ? w.size() : 0;
+}
 
-    std::cout << "\033[?25h"; // show cursor
+// Decodes into out (capacity cap). base must be the snapshot whose seq the
+// packet names as its baseline, or null for a full snapshot. Returns false on
+// malformed input, a baseline mismatch or insufficient capacity.
+bool decodeSnapshot(const uint8_t* in, size_t n, const SnapshotSpan* base, QuantEntity* out, uint32_t cap,
+                    uint32_t& outCount, uint32_t& outSeq) {
+    ByteReader r(in, n);
+    if (r.get() != WIRE_VERSION) return false;
+    outSeq = r.varint();
+    uint32_t baseSeq = r.varint();
+    if (baseSeq != 0 && (!base || base->seq != baseSeq)) return false;
+    if (baseSeq == 0) base = nullptr;
+    uint32_t count = r.varint();
+    if (!r.ok() || count > cap) return false;
+    uint32_t id = 0;
+    for (uint32_t i = 0; i < count; i++) { id += r.varint(); out[i].id = id; }
+
+    const uint8_t* flags = r.take((count + 7) / 8);
+    if (!flags) return false;
+    uint32_t b = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        QuantEntity& e = out[i];
+        while (base && b < base->count && base->ents[b].id < e.id) b++;
+        const QuantEntity* prev = (base && b < base->count && base->ents[b].id == e.id) ? &base->ents[b] : nullptr;
+        if (!(flags[i >> 3] & (1 << (i & 7)))) {
+            if (!prev) return false; // unchanged but not in the baseline
+            e.x = prev->x; e.y = prev->y; e.z = prev->z;
+            continue;
+        }
+        e.x = int16_t(r.zigzag() + (prev ? prev->x : 0));
+        e.y = int16_t(r.zigzag() + (prev ? prev->y : 0));
+        e.z = int16_t(r.zigzag() + (prev ? prev->z : 0));
+    }
+    outCount = count;
+    return r.ok();
 }
 
-//Client
-void clientThread(int id, int latencyMs = 50) {
-    serverState[id] = std::make_tuple(0.0f, 0.0f, 0.0f);
-    clientPredicted[id] = std::make_tuple(0.0f, 0.0f, 0.0f);
+// Reference encoding: count, then id + three raw floats per entity
+size_t encodeSnapshotNaive(const SnapshotSpan& cur, uint8_t* out, size_t cap) {
+    size_t need = 8 + size_t(cur.count) * 16;
+    if (cap < need) return 0;
+    std::memcpy(out, &cur.seq, 4);
+    std::memcpy(out + 4, &cur.count, 4);
+    uint8_t* p = out + 8;
+    for (uint32_t i = 0; i < cur.count; i++) {
+        const QuantEntity& e = cur.ents[i];
+        float f[3] = { dequantize(e.x, quantExtent()), dequantize(e.y, quantExtent()), dequantize(e.z, Z_EXTENT) };
+        std::memcpy(p, &e.id, 4);
+        std::memcpy(p + 4, f, 12);
+        p += 16;
+    }
+    return need;
+}
 
-    std::vector<std::string> actions = { "Move","Jump","Shoot" };
-    while (!done) {
-        GameAction a;
-        a.clientID = id;
-        a.type = actions[int(getRandomFloat(0.0f, 3.0f)) % 3];
-        if (a.type == "Move") { a.dx = getRandomFloat(-1.0f, 1.0f); a.dy = getRandomFloat(-1.0f, 1.0f); }
-        else a.dz = getRandomFloat(-3.0f, 3.0f);
+bool decodeSnapshotNaive(const uint8_t* in, size_t n, QuantEntity* out, uint32_t cap, uint32_t& outCount, uint32_t& outSeq) {
+    if (n < 8) return false;
+    uint32_t count;
+    std::memcpy(&outSeq, in, 4);
+    std::memcpy(&count, in + 4, 4);
+    if (count > cap || n < 8 + size_t(count) * 16) return false;
+    const uint8_t* p = in + 8;
+    for (uint32_t i = 0; i < count; i++) {
+        float f[3];
+        std::memcpy(&out[i].id, p, 4);
+        std::memcpy(f, p + 4, 12);
+        out[i].x = quantize(f[0], quantExtent()); out[i].y = quantize(f[1], quantExtent()); out[i].z = quantize(f[2], Z_EXTENT);
+        p += 16;
+    }
+    outCount = count;
+    return true;
+}
 
-        {
-            std::lock_guard<std::mutex> lock(stateMutex);
-            auto& pred = clientPredicted[id];
-            float x = std::get<0>(pred);
-            float y = std::get<1>(pred);
-            float z = std::get<2>(pred);
-            if (a.type == "Move") { x += a.dx; y += a.dy; }
-            else z = a.dz;
-            pred = std::make_tuple(x, y, z);
-        }
+// Tick log: an append-only record of everything the simulation consumed, one
+// record per tick that applied actions or saw new entities.
+//
+// Header: "AELG" | u32 version | u32 tick rate | u32 seed | u16 world cols | u16 world rows | u32 flags
+// Record: u8 'T' | varint body length | body
+// Body:   varint tick delta | varint joins | varint actions |
+//         joins x varint client ID |
+//         actions x (varint clientID, u8 kind | flags << 4, zigzag dx dy dz, varint seq) |
+//         u64 checksum of serverState after the tick
+// Footer: u8 'I' | varint entries | entries x (varint tick delta, varint offset delta) |
+//         u64 footer offset | "AEIX"
+//
+// Rejected actions are logged with ACTION_ILLEGAL set; a replay that reaches a
+// different verdict changes a penalty and so fails the checksum. A Shoot's dz
+// is the rewind the server gave it (see resolveShots), so replays rewind
+// the same way without knowing anyone's latency. Ticks without a record
+// applied nothing, but jumps kept falling through them, so a replay runs
+// those ticks too while anything is airborne. The footer is
+// a sparse tick -> offset index, one entry per TICK_INDEX_BYTES of records; a
+// log cut short by a crash has none and is indexed by skipping record bodies.
+const char TICK_LOG_MAGIC[4] = { 'A', 'E', 'L', 'G' };
+const char TICK_INDEX_MAGIC[4] = { 'A', 'E', 'I', 'X' };
+const uint32_t TICK_LOG_VERSION = 6;
+const size_t TICK_LOG_HEADER_BYTES = 24;
+const uint32_t TICK_LOG_SCATTER_SPAWNS = 1; // header flag: joins were placed by spawnPoint with scatterSpawns
+const size_t TICK_INDEX_TRAILER_BYTES = 12;
+const uint8_t TICK_RECORD = 'T';
+const uint8_t TICK_INDEX = 'I';
+const size_t TICK_RECORD_MAX_ACTION_BYTES = 5 + 1 + 3 * 3 + 5;
+const size_t TICK_INDEX_BYTES = 64 << 10;
+
+inline uint64_t mix64(uint64_t v) {
+    v ^= v >> 30; v *= 0xbf58476d1ce4e5b9ull;
+    v ^= v >> 27; v *= 0x94d049bb133111ebull;
+    return v ^ (v >> 31);
+}
+inline uint32_t floatBits(float f) { uint32_t u; std::memcpy(&u, &f, 4); return u; }
 
-        actionQueue.push(a);
-        std::this_thread::sleep_for(std::chrono::milliseconds(latencyMs));
+// Sum of per-entity hashes over live entities, so it doesn't depend on dense
+// slot order (which follows thread timing)
+uint64_t stateChecksum(const EntityStore& s) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < s.size(); i++) {
+        if (!s.alive[i]) continue;
+        uint64_t h = mix64(s.ids[i] ^ (uint64_t(s.lastInput[i]) << 32));
+        h = mix64(h ^ floatBits(s.x[i]) ^ (uint64_t(floatBits(s.y[i])) << 32));
+        h = mix64(h ^ floatBits(s.z[i]) ^ (uint64_t(uint32_t(s.penalty[i])) << 32));
+        h = mix64(h ^ s.timesHit[i] ^ (uint64_t(floatBits(s.vz[i])) << 32));
+        sum += h;
     }
+    return sum;
 }
 
-int main() {
-    // Disable buffering for live output
-    setvbuf(stdout, nullptr, _IONBF, 0);
-#ifdef _WIN32
-    EnableVTMode();
+struct TickRecord {
+    uint64_t tick = 0;
+    std::vector<uint32_t> joins;
+    std::vector<GameAction> actions;
+    uint64_t checksum = 0;
+};
+
+struct TickIndexEntry {
+    uint64_t tick;   // first tick of the record at offset
+    uint64_t offset;
+};
+
+class TickLogWriter {
+    FILE* f = nullptr;
+    std::vector<uint8_t> buf;
+    std::vector<TickIndexEntry> index;
+    uint64_t lastTick = 0, lastIndexed = 0;
+
+    void writeIndex() {
+        std::vector<uint8_t> out(1 + 5 + index.size() * 20 + TICK_INDEX_TRAILER_BYTES);
+        ByteWriter w(out.data(), out.size());
+        w.put(TICK_INDEX);
+        w.varint(uint32_t(index.size()));
+        uint64_t tick = 0, offset = 0;
+        for (const TickIndexEntry& e : index) {
+            w.varint(uint32_t(e.tick - tick));
+            w.varint(uint32_t(e.offset - offset));
+            tick = e.tick; offset = e.offset;
+        }
+        if (uint8_t* t = w.reserve(TICK_INDEX_TRAILER_BYTES)) { std::memcpy(t, &bytes, 8); std::memcpy(t + 8, TICK_INDEX_MAGIC, 4); }
+        bytes += std::fwrite(out.data(), 1, w.size(), f);
+    }
+public:
+    uint64_t records = 0, actions = 0, bytes = 0;
+
+    ~TickLogWriter() { close(); }
+    bool open(const std::string& path, uint32_t tickHz, uint32_t seed, uint16_t worldCols, uint16_t worldRows, uint32_t flags) {
+        f = std::fopen(path.c_str(), "wb");
+        if (!f) return false;
+        std::setvbuf(f, nullptr, _IOFBF, 1 << 20);
+        uint8_t h[TICK_LOG_HEADER_BYTES];
+        std::memcpy(h, TICK_LOG_MAGIC, 4);
+        std::memcpy(h + 4, &TICK_LOG_VERSION, 4);
+        std::memcpy(h + 8, &tickHz, 4);
+        std::memcpy(h + 12, &seed, 4);
+        std::memcpy(h + 16, &worldCols, 2);
+        std::memcpy(h + 18, &worldRows, 2);
+        std::memcpy(h + 20, &flags, 4);
+        bytes = std::fwrite(h, 1, sizeof(h), f);
+        return bytes == sizeof(h);
+    }
+    bool isOpen() const { return f != nullptr; }
+    void write(uint64_t tick, const uint32_t* joins, size_t nJoins, const GameAction* acts, size_t n, uint64_t checksum) {
+        if (!f || (nJoins == 0 && n == 0)) return;
+        const size_t head = 6; // tag plus the longest body length varint
+        buf.resize(head + 15 + nJoins * 5 + n * TICK_RECORD_MAX_ACTION_BYTES + 8);
+        ByteWriter w(buf.data() + head, buf.size() - head);
+        w.varint(uint32_t(tick - lastTick));
+        w.varint(uint32_t(nJoins));
+        w.varint(uint32_t(n));
+        for (size_t i = 0; i < nJoins; i++) w.varint(joins[i]);
+        for (size_t i = 0; i < n; i++) {
+            const GameAction& a = acts[i];
+            w.varint(a.clientID);
+            w.put(uint8_t(uint8_t(a.kind) | a.flags << 4));
+            w.zigzag(a.dx); w.zigzag(a.dy); w.zigzag(a.dz);
+            w.varint(a.seq);
+        }
+        if (uint8_t* c = w.reserve(8)) std::memcpy(c, &checksum, 8);
+
+        // Prefix goes right-aligned in front of the body, so the record is one fwrite
+        uint8_t prefix[head];
+        ByteWriter pw(prefix, sizeof(prefix));
+        pw.put(TICK_RECORD);
+        pw.varint(uint32_t(w.size()));
+        uint8_t* start = buf.data() + head - pw.size();
+        std::memcpy(start, prefix, pw.size());
+
+        if (records == 0 || bytes - lastIndexed >= TICK_INDEX_BYTES) {
+            index.push_back({ tick, bytes });
+            lastIndexed = bytes;
+        }
+        bytes += std::fwrite(start, 1, pw.size() + w.size(), f);
+        lastTick = tick;
+        records++;
+        actions += n;
+    }
+    void close() {
+        if (!f) return;
+        writeIndex();
+        std::fclose(f);
+        f = nullptr;
+    }
+};
+
+// Read-only view of a tick log. The file is mapped rather than read, so a
+// multi-GB log costs address space, not memory; cursors release pages behind
+// them as they go. After open() the reader is immutable, so any number of
+// threads can scan disjoint ranges through their own cursors.
+class TickLogReader {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    size_t recordsEnd = 0; // footer offset, or the end of the last whole record
+    std::vector<TickIndexEntry> index;
+#ifndef _WIN32
+    void* mapping = nullptr;
+#else
+    std::vector<uint8_t> owned;
 #endif
 
-    const int numClients = 2;
-    std::vector<int> clientIDs;
-    std::vector<std::thread> clients;
-    for (int i = 1; i <= numClients; i++) clientIDs.push_back(i);
+    // Parses a record's prefix and tick delta; body is where the delta starts
+    bool peek(size_t pos, size_t& body, size_t& next, uint32_t& delta) const {
+        if (pos >= recordsEnd || data[pos] != TICK_RECORD) return false;
+        ByteReader r(data + pos + 1, recordsEnd - pos - 1);
+        uint32_t len = r.varint();
+        body = size_t(r.take(0) - data);
+        if (!r.ok() || len > recordsEnd - body) return false;
+        next = body + len;
+        ByteReader b(data + body, len);
+        delta = b.varint();
+        return b.ok();
+    }
+    bool loadIndex() {
+        if (size < TICK_LOG_HEADER_BYTES + TICK_INDEX_TRAILER_BYTES) return false;
+        const uint8_t* t = data + size - TICK_INDEX_TRAILER_BYTES;
+        uint64_t at;
+        std::memcpy(&at, t, 8);
+        if (std::memcmp(t + 8, TICK_INDEX_MAGIC, 4) != 0 || at < TICK_LOG_HEADER_BYTES || at >= size - TICK_INDEX_TRAILER_BYTES) return false;
+        ByteReader r(data + at, size - TICK_INDEX_TRAILER_BYTES - at);
+        if (r.get() != TICK_INDEX) return false;
+        uint32_t n = r.varint();
+        if (!r.ok() || n > size) return false;
+        uint64_t tick = 0, offset = 0;
+        index.resize(n);
+        for (uint32_t i = 0; i < n; i++) {
+            tick += r.varint(); offset += r.varint();
+            if (offset >= at) return false;
+            index[i] = { tick, offset };
+        }
+        recordsEnd = size_t(at);
+        return r.ok();
+    }
+    // No footer: walk record prefixes, which never touches action data
+    void buildIndex() {
+        index.clear();
+        recordsEnd = size;
+        size_t pos = TICK_LOG_HEADER_BYTES, body, next, lastIndexed = 0;
+        uint32_t delta;
+        uint64_t tick = 0;
+        while (peek(pos, body, next, delta)) {
+            tick += delta;
+            if (index.empty() || pos - lastIndexed >= TICK_INDEX_BYTES) { index.push_back({ tick, pos }); lastIndexed = pos; }
+            pos = next;
+        }
+        recordsEnd = pos;
+    }
+public:
+    uint32_t tickHz = 0, seed = 0;
+    uint16_t worldCols = 0, worldRows = 0;
+    uint32_t flags = 0;
+    bool indexed = false; // footer index was present
+    uint64_t firstTick = 0, lastTick = 0;
 
-    std::thread server(serverThread, clientIDs, 50);
-    for (int id : clientIDs) clients.emplace_back(clientThread, id, 50);
+    class Cursor {
+        const TickLogReader* log;
+        size_t pos;
+        uint64_t tick;    // tick of the previous record
+        size_t released;  // pages before this were handed back to the kernel
+    public:
+        Cursor(const TickLogReader* l, size_t p, uint64_t base) : log(l), pos(p), tick(base), released(p) {}
+        // Tick of the next record without decoding it; false at the end
+        bool peekTick(uint64_t& t) const {
+            size_t body, next; uint32_t delta;
+            if (!log->peek(pos, body, next, delta)) return false;
+            t = tick + delta;
+            return true;
+        }
+        bool skip() {
+            size_t body, next; uint32_t delta;
+            if (!log->peek(pos, body, next, delta)) return false;
+            tick += delta;
+            pos = next;
+            return true;
+        }
+        // False at the end of the log or on a corrupt record
+        bool next(TickRecord& rec) {
+            size_t body, next; uint32_t delta;
+            if (!log->peek(pos, body, next, delta)) return false;
+            ByteReader r(log->data + body, next - body);
+            rec.tick = tick + r.varint();
+            uint32_t nJoins = r.varint(), n = r.varint();
+            if (!r.ok() || nJoins > next - body || n > next - body) return false;
+            rec.joins.resize(nJoins);
+            for (uint32_t i = 0; i < nJoins; i++) rec.joins[i] = r.varint();
+            rec.actions.resize(n);
+            for (uint32_t i = 0; i < n; i++) {
+                GameAction& a = rec.actions[i];
+                a.clientID = r.varint();
+                uint8_t kf = r.get();
+                a.kind = ActionKind(kf & 0x0F);
+                a.flags = uint8_t(kf >> 4);
+                a.dx = int16_t(r.zigzag()); a.dy = int16_t(r.zigzag()); a.dz = int16_t(r.zigzag());
+                a.seq = r.varint();
+                if (a.kind >= ActionKind::Count) return false;
+            }
+            const uint8_t* c = r.take(8);
+            if (!r.ok() || !c) return false;
+            std::memcpy(&rec.checksum, c, 8);
+            tick = rec.tick;
+            pos = next;
+            releaseBehind();
+            return true;
+        }
+        void releaseBehind() {
+#ifndef _WIN32
+            const size_t window = 64 << 20;
+            if (pos - released < window) return;
+            size_t page = size_t(sysconf(_SC_PAGESIZE));
+            size_t from = released / page * page, to = pos / page * page;
+            if (to > from) madvise(const_cast<uint8_t*>(log->data) + from, to - from, MADV_DONTNEED);
+            released = to;
+#endif
+        }
+    };
 
-    std::this_thread::sleep_for(std::chrono::seconds(15));
-    done = true;
+    ~TickLogReader() {
+#ifndef _WIN32
+        if (mapping) munmap(mapping, size);
+#endif
+    }
+    bool open(const std::string& path) {
+#ifndef _WIN32
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            size = size_t(st.st_size);
+            void* m = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (m != MAP_FAILED) { mapping = m; data = static_cast<const uint8_t*>(m); }
+        }
+        ::close(fd);
+        if (!data) return false;
+#else
+        FILE* f = std::fopen(path.c_str(), "rb");
+        if (!f) return false;
+        uint8_t chunk[1 << 16];
+        size_t n;
+        while ((n = std::fread(chunk, 1, sizeof(chunk), f)) > 0) owned.insert(owned.end(), chunk, chunk + n);
+        std::fclose(f);
+        data = owned.data(); size = owned.size();
+#endif
+        uint32_t version;
+        if (size < TICK_LOG_HEADER_BYTES || std::memcmp(data, TICK_LOG_MAGIC, 4) != 0) return false;
+        std::memcpy(&version, data + 4, 4);
+        std::memcpy(&tickHz, data + 8, 4);
+        std::memcpy(&seed, data + 12, 4);
+        std::memcpy(&worldCols, data + 16, 2);
+        std::memcpy(&worldRows, data + 18, 2);
+        std::memcpy(&flags, data + 20, 4);
+        if (version != TICK_LOG_VERSION || tickHz == 0 || worldCols % 2 == 0 || worldRows % 2 == 0) return false;
+        indexed = loadIndex();
+        if (!indexed) buildIndex();
+        if (!index.empty()) {
+            firstTick = index.front().tick;
+            Cursor c = cursorAt(index.size() - 1);
+            while (c.peekTick(lastTick)) c.skip();
+        }
+        return true;
+    }
+    size_t indexEntries() const { return index.size(); }
+    uint64_t bytes() const { return size; }
 
-    for (auto& c : clients) c.join();
-    server.join();
+    Cursor cursorAt(size_t entry) const {
+        const TickIndexEntry& e = index[entry];
+        size_t body, next; uint32_t delta = 0;
+        peek(size_t(e.offset), body, next, delta);
+        return Cursor(this, size_t(e.offset), e.tick - delta);
+    }
+    // Positioned on the first record with tick >= from
+    Cursor seek(uint64_t from) const {
+        if (index.empty()) return Cursor(this, recordsEnd, 0);
+        auto it = std::upper_bound(index.begin(), index.end(), from, [](uint64_t t, const TickIndexEntry& e) { return t < e.tick; });
+        Cursor c = cursorAt(it == index.begin() ? 0 : size_t(it - index.begin()) - 1);
+        uint64_t t;
+        while (c.peekTick(t) && t < from) c.skip();
+        return c;
+    }
+};
 
-    std::cout << "\nFinal penalties:\n";
-    for (auto& p : penalties) std::cout << "Client " << p.first << "=" << p.second << "\n";
-    std::cout << "Simulation finished.\n";
-    return 0;
-}
+// Where every entity was at the start of each of the last
+// POSITION_HISTORY_TICKS ticks, for rewinding shots. One row per tick
+// (tick % POSITION_HISTORY_TICKS), each a pair of int16 columns quantized
+// like the wire format and laid out in serverState's dense order, so
+// recording a tick is two streaming passes. serverState never compacts, so an
+// index names the same entity in every row; HISTORY_EMPTY marks one that
+// didn't exist yet. Ticks skipped since the last record() get the same row:
+// a replay may skip ticks without actions, and nothing moved in x or y in those.
+const size_t POSITION_HISTORY_TICKS = 64; // about 1 s at the default tick rate
+const int16_t HISTORY_EMPTY = INT16_MIN;  // quantize() never produces it
 
+class PositionHistory {
+    std::vector<int16_t> qx, qy; // [row * stride + index]
+    size_t stride = 0;
+    uint64_t rowTick[POSITION_HISTORY_TICKS];
+    bool rowUsed[POSITION_HISTORY_TICKS] = {};
+    uint64_t nextTick = 0; // first tick record() hasn't written
+
+    void grow(size_t n) {
+        size_t wider = std::max(n, 2 * stride);
+        std::vector<int16_t> nx(POSITION_HISTORY_TICKS * wider, HISTORY_EMPTY), ny(nx);
+        for (size_t r = 0; r < POSITION_HISTORY_TICKS; r++)
+            for (size_t i = 0; i < stride; i++) { nx[r * wider + i] = qx[r * stride + i]; ny[r * wider + i] = qy[r * stride + i]; }
+        qx.swap(nx); qy.swap(ny);
+        stride = wider;
+    }
+    int16_t* row(std::vector<int16_t>& col, uint64_t tick) { return col.data() + (tick % POSITION_HISTORY_TICKS) * stride; }
+
+public:
+    void record(const EntityStore& st, uint64_t tick) {
+        if (st.size() > stride) grow(st.size());
+        int16_t* rx = row(qx, tick);
+        int16_t* ry = row(qy, tick);
+        const float e = quantExtent();
+        for (size_t i = 0; i < st.size(); i++) {
+            rx[i] = st.alive[i] ? quantize(st.x[i], e) : HISTORY_EMPTY;
+            ry[i] = st.alive[i] ? quantize(st.y[i], e) : HISTORY_EMPTY;
+        }
+        uint64_t from = std::max(nextTick, tick + 1 >= POSITION_HISTORY_TICKS ? tick + 1 - POSITION_HISTORY_TICKS : 0);
+        for (uint64_t t = from; t <= tick; t++) {
+            size_t r = t % POSITION_HISTORY_TICKS;
+            if (t != tick) {
+                std::copy(rx, rx + stride, qx.begin() + r * stride);
+                std::copy(ry, ry + stride, qy.begin() + r * stride);
+            }
+            rowTick[r] = t;
+            rowUsed[r] = true;
+        }
+        nextTick = tick + 1;
+    }
+    // Position of the entity at dense index idx as of tick; false when that
+    // tick has left the ring or the entity didn't exist then
+    bool at(uint32_t idx, uint64_t tick, float& x, float& y) const {
+        size_t r = tick % POSITION_HISTORY_TICKS;
+        if (!rowUsed[r] || rowTick[r] != tick || idx >= stride) return false;
+        int16_t hx = qx[r * stride + idx], hy = qy[r * stride + idx];
+        if (hx == HISTORY_EMPTY) return false;
+        x = dequantize(hx, quantExtent()); y = dequantize(hy, quantExtent());
+        return true;
+    }
+    // One entity's ring, newest tick first, for a checkpoint taken after tick
+    void save(uint32_t idx, uint64_t tick, int16_t* out) const {
+        for (size_t k = 0; k < POSITION_HISTORY_TICKS; k++) {
+            size_t r = (tick - k) % POSITION_HISTORY_TICKS;
+            bool ok = k <= tick && rowUsed[r] && rowTick[r] == tick - k && idx < stride;
+            out[2 * k] = ok ? qx[r * stride + idx] : HISTORY_EMPTY;
+            out[2 * k + 1] = ok ? qy[r * stride + idx] : HISTORY_EMPTY;
+        }
+    }
+    void load(uint32_t idx, uint64_t tick, const int16_t* in) {
+        if (idx >= stride) grow(size_t(idx) + 1);
+        for (size_t k = 0; k < POSITION_HISTORY_TICKS && k <= tick; k++) {
+            size_t r = (tick - k) % POSITION_HISTORY_TICKS;
+            rowTick[r] = tick - k;
+            rowUsed[r] = true;
+            qx[r * stride + idx] = in[2 * k];
+            qy[r * stride + idx] = in[2 * k + 1];
+        }
+        nextTick = tick + 1;
+    }
+};
+PositionHistory positionHistory; // serverState's, written by the tick
+
+// Checkpoint: the full simulated state after one tick, so a restart only has
+// to replay the log records after it.
+//
+// "AECP" | u32 version | u64 tick | u32 entities | u16 world cols | u16 world rows |
+// entities x (u32 id, f32 x y z vz, i32 penalty, u32 lastInput, u32 timesHit, RuleState,
+//             POSITION_HISTORY_TICKS x (i16 x, i16 y), newest first) | u64 stateChecksum
+//
+// Floats are stored raw: the replayed tail must continue from bit-identical state.
+// The position history goes along so shots just after a resume rewind exactly
+// as they did in the original run.
+const char CHECKPOINT_MAGIC[4] = { 'A', 'E', 'C', 'P' };
+const uint32_t CHECKPOINT_VERSION = 5;
+const size_t CHECKPOINT_HEADER_BYTES = 24;
+const size_t CHECKPOINT_HISTORY_BYTES = POSITION_HISTORY_TICKS * 4;
+const size_t CHECKPOINT_ENTITY_BYTES = 32 + sizeof(RuleState) + CHECKPOINT_HISTORY_BYTES;
+const uint32_t MAX_CHECKPOINT_ID = 1u << 24; // bounds slotOf growth from a corrupt file
+
+void encodeCheckpoint(const EntityStore& st, const PositionHistory& hist, uint64_t tick, std::vector<uint8_t>& out) {
+    uint32_t n = 0;
+    for (size_t i = 0; i < st.size(); i++) n += st.alive[i];
+    out.resize(CHECKPOINT_HEADER_BYTES + size_t(n) * CHECKPOINT_ENTITY_BYTES + 8);
+    uint8_t* p = out.data();
+    std::memcpy(p, CHECKPOINT_MAGIC, 4);
+    std::memcpy(p + 4, &CHECKPOINT_VERSION, 4);
+    std::memcpy(p + 8, &tick, 8);
+    std::memcpy(p + 16, &n, 4);
+    uint16_t cols = uint16_t(world.width()), rows = uint16_t(world.height());
+    std::memcpy(p + 20, &cols, 2);
+    std::memcpy(p + 22, &rows, 2);
+    p += CHECKPOINT_HEADER_BYTES;
+    for (size_t i = 0; i < st.size(); i++) {
+        if (!st.alive[i]) continue;
+        std::memcpy(p, &st.ids[i], 4);
+        std::memcpy(p + 4, &st.x[i], 4); std::memcpy(p + 8, &st.y[i], 4); std::memcpy(p + 12, &st.z[i], 4); std::memcpy(p + 16, &st.vz[i], 4);
+        std::memcpy(p + 20, &st.penalty[i], 4);
+        std::memcpy(p + 24, &st.lastInput[i], 4);
+        std::memcpy(p + 28, &st.timesHit[i], 4);
+        std::memcpy(p + 32, &st.rules[i], sizeof(RuleState));
+        int16_t ring[2 * POSITION_HISTORY_TICKS];
+        hist.save(uint32_t(i), tick, ring);
+        std::memcpy(p + 32 + sizeof(RuleState), ring, CHECKPOINT_HISTORY_BYTES);
+        p += CHECKPOINT_ENTITY_BYTES;
+    }
+    uint64_t sum = stateChecksum(st);
+    std::memcpy(p, &sum, 8);
+}
+
+// Puts every checkpointed entity into st; false if the file is malformed, was
+// taken in a different size of world, or the restored state doesn't hash to
+// the stored checksum
+bool decodeCheckpoint(const uint8_t* in, size_t n, EntityStore& st, PositionHistory& hist, uint64_t& tick) {
+    uint32_t version, count;
+    uint16_t cols, rows;
+    if (n < CHECKPOINT_HEADER_BYTES + 8 || std::memcmp(in, CHECKPOINT_MAGIC, 4) != 0) return false;
+    std::memcpy(&version, in + 4, 4);
+    std::memcpy(&tick, in + 8, 8);
+    std::memcpy(&count, in + 16, 4);
+    std::memcpy(&cols, in + 20, 2);
+    std::memcpy(&rows, in + 22, 2);
+    if (version != CHECKPOINT_VERSION || n != CHECKPOINT_HEADER_BYTES + size_t(count) * CHECKPOINT_ENTITY_BYTES + 8) return false;
+    if (cols != world.width() || rows != world.height()) return false;
+    const uint8_t* p = in + CHECKPOINT_HEADER_BYTES;
+    for (uint32_t i = 0; i < count; i++) {
+        EntityRecord r;
+        std::memcpy(&r.id, p, 4);
+        std::memcpy(&r.x, p + 4, 4); std::memcpy(&r.y, p + 8, 4); std::memcpy(&r.z, p + 12, 4); std::memcpy(&r.vz, p + 16, 4);
+        std::memcpy(&r.penalty, p + 20, 4);
+        std::memcpy(&r.lastInput, p + 24, 4);
+        std::memcpy(&r.timesHit, p + 28, 4);
+        std::memcpy(&r.rules, p + 32, sizeof(RuleState));
+        if (r.id >= MAX_CHECKPOINT_ID) return false;
+        int16_t ring[2 * POSITION_HISTORY_TICKS];
+        std::memcpy(ring, p + 32 + sizeof(RuleState), CHECKPOINT_HISTORY_BYTES);
+        hist.load(st.put(r), tick, ring);
+        p += CHECKPOINT_ENTITY_BYTES;
+    }
+    uint64_t sum;
+    std::memcpy(&sum, p, 8);
+    return sum == stateChecksum(st);
+}
+
+// Writes checkpoints off the tick thread. The tick serializes under stateMutex
+// and swaps its buffer in; this thread writes PATH.tmp and renames it over
+// PATH, so a crash mid-write leaves the previous checkpoint intact. A
+// checkpoint still waiting when the next arrives is superseded, not queued.
+class CheckpointWriter {
+    std::string path;
+    std::thread thread;
+    std::mutex m;
+    std::condition_variable cv;
+    std::vector<uint8_t> pending, writing;
+    bool hasPending = false, stopping = false;
+
+    bool writeFile(const std::vector<uint8_t>& buf) {
+        std::string tmp = path + ".tmp";
+        FILE* f = std::fopen(tmp.c_str(), "wb");
+        if (!f) return false;
+        bool ok = std::fwrite(buf.data(), 1, buf.size(), f) == buf.size() && std::fflush(f) == 0;
+#ifndef _WIN32
+        ok = ok && fsync(fileno(f)) == 0;
+#endif
+        ok = std::fclose(f) == 0 && ok;
+#ifdef _WIN32
+        std::remove(path.c_str());
+#endif
+        return ok && std::rename(tmp.c_str(), path.c_str()) == 0;
+    }
+    void loop() {
+        pinThisThread(placement.io);
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(m);
+                cv.wait(lock, [&] { return hasPending || stopping; });
+                if (!hasPending) return;
+                writing.swap(pending);
+                hasPending = false;
+            }
+            if (writeFile(writing)) { written.fetch_add(1, std::memory_order_relaxed); lastBytes.store(writing.size(), std::memory_order_relaxed); }
+            else failed.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+public:
+    std::atomic<uint64_t> written{ 0 }, failed{ 0 }, superseded{ 0 }, lastBytes{ 0 };
+
+    ~CheckpointWriter() { stop(); }
+    void start(const std::string& p) { path = p; thread = std::thread(&CheckpointWriter::loop, this); }
+    bool active() const { return thread.joinable(); }
+    // Takes buf's contents; buf comes back holding an older buffer to reuse
+    void submit(std::vector<uint8_t>& buf) {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            if (hasPending) superseded.fetch_add(1, std::memory_order_relaxed);
+            pending.swap(buf);
+            hasPending = true;
+        }
+        cv.notify_one();
+    }
+    // Writes whatever is pending, then exits
+    void stop() {
+        if (!thread.joinable()) return;
+        { std::lock_guard<std::mutex> lock(m); stopping = true; }
+        cv.notify_one();
+        thread.join();
+    }
+};
+
+// Shared resources
+// Queue entry: the action plus the client's submit time, used to model latency.
+// It is a plain value copied into the ring's preallocated slots and on into
+// the tick's reused buffers, so no action owns heap memory and a pool
+// allocator would have nothing to pool.
+struct QueuedAction {
+    GameAction action;
+    int64_t submitNs;
+};
+static_assert(std::is_trivially_copyable<QueuedAction>::value, "actions are queued and buffered by value");
+
+const size_t ACTION_QUEUE_CAPACITY = 4096;
+const size_t ACTION_BATCH = 256; // max actions drained per try_pop_n
+const size_t MAX_PENDING_ACTIONS = 65536; // in-flight actions the server buffers before leaving the rest queued
+MPSCRing<QueuedAction> actionQueue(ACTION_QUEUE_CAPACITY, FullPolicy::Block);
+const uint32_t SNAPSHOT_RING = 16; // snapshots kept per client as delta baselines
+
+// Transports carry actions client -> server and, for remote clients, encoded
+// authoritative state server -> client. The in-process pair wraps actionQueue
+// and clientReceived; the UDP pair (Linux) moves datagrams with recvmmsg/sendmmsg
+// through preallocated buffers.
+//
+// Action datagram:   u8 'A' | u8 version | u16 count | u32 clientID | u32 snapshot ack | count x (GameAction, i64 submitNs)
+// Snapshot datagram: u8 'S' | u32 input ack | encodeSnapshot payload
+const uint8_t PACKET_ACTIONS = 'A';
+const uint8_t PACKET_SNAPSHOT = 'S';
+const size_t ACTION_HEADER_BYTES = 12;
+const size_t SNAPSHOT_HEADER_BYTES = 5;
+const size_t ACTION_WIRE_BYTES = sizeof(GameAction) + sizeof(int64_t);
+const size_t MAX_ACTIONS_PER_PACKET = 56; // keeps action datagrams under a 1500-byte MTU
+const size_t MAX_DATAGRAM = 65000;
+const size_t UDP_BATCH = 64;              // datagrams per recvmmsg/sendmmsg
+const uint32_t MAX_REMOTE_CLIENT_ID = 1u << 20; // bounds per-ID tables against bogus packets
+
+class ServerTransport {
+public:
+    virtual ~ServerTransport() {}
+    virtual size_t receive(QueuedAction* out, size_t max) = 0;
+    virtual size_t backlog() const { return 0; }
+    // Transports with real clients report snapshot acks and carry snapshots back
+    virtual bool remote() const { return false; }
+    virtual uint32_t ackedSnapshot(uint32_t) const { return 0; }
+    virtual void sendSnapshot(uint32_t, uint32_t, const uint8_t*, size_t) {}
+    virtual void flush() {}
+    virtual void appendMetrics(std::vector<struct Metric>&) const {}
+};
+
+class ClientTransport {
+public:
+    virtual ~ClientTransport() {}
+    virtual bool send(const GameAction& a, int64_t submitNs) = 0;
+    virtual void flush() {}
+    // True when new authoritative state for this client arrived; inputAck is
+    // the highest input seq the server had applied to it
+    virtual bool poll(float& x, float& y, float& z, uint32_t& inputAck) = 0;
+};
+
+class InProcessServerTransport : public ServerTransport {
+    MPSCRing<QueuedAction>& queue;
+public:
+    explicit InProcessServerTransport(MPSCRing<QueuedAction>& q) : queue(q) {}
+    size_t receive(QueuedAction* out, size_t max) override { return queue.try_pop_n(out, max); }
+    size_t backlog() const override { return queue.size_approx(); }
+};
+
+class InProcessClientTransport : public ClientTransport {
+    MPSCRing<QueuedAction>& queue;
+    uint32_t clientID;
+    uint64_t seenVersion = 0;
+public:
+    InProcessClientTransport(MPSCRing<QueuedAction>& q, uint32_t id) : queue(q), clientID(id) {}
+    bool send(const GameAction& a, int64_t submitNs) override { return queue.push({ a, submitNs }); }
+    bool poll(float& x, float& y, float& z, uint32_t& inputAck) override; // reads clientReceived without stateMutex, defined below
+};
+
+inline void putU32(uint8_t* p, uint32_t v) { std::memcpy(p, &v, 4); }
+inline uint32_t getU32(const uint8_t* p) { uint32_t v; std::memcpy(&v, p, 4); return v; }
+inline void putU16(uint8_t* p, uint16_t v) { std::memcpy(p, &v, 2); }
+inline uint16_t getU16(const uint8_t* p) { uint16_t v; std::memcpy(&v, p, 2); return v; }
+
+// Multi-node cluster (--cluster): the world's vertical strips are first split
+// between server nodes, left to right in list order, and each node's shards
+// cut up its own strip. A node simulates only the entities inside its strip.
+// - An entity that ends a tick past the strip's edge migrates: it is handed
+//   to the node whose strip it entered in numbered batches, resent until
+//   acknowledged and applied in order. IDs and positions travel as a full
+//   snapshot in the client wire format, followed by the exact state the
+//   snapshot's quantization loses; the receiver checks one against the other.
+// - Each tick a node sends each neighbour a snapshot of its entities within
+//   the border band of their shared edge. The neighbour replicates these
+//   ghosts to its own clients, so an area of interest reaches across nodes.
+// - Actions for an entity that lives elsewhere are forwarded to the node that
+//   has it, and its client is told to reconnect there.
+// Everything runs on the tick thread; the UDP transport carries the packets.
+//
+// Every peer datagram stays within PEER_DATAGRAM_BYTES, so none is fragmented
+// and a lost packet costs only what it carried. Migration batches are sized to
+// fit, and a border set too large for one datagram is split into parts that
+// the neighbour applies once it has them all.
+//
+// Peer datagrams start u8 type | u8 version | u16 from node | u32 tick:
+//   'M' migration: | u32 batch | u16 count | u32 snapshot bytes | encodeSnapshot payload | count x MIGRATE_RECORD_BYTES
+//                  record: f32 x y z vz, i32 penalty, u32 lastInput, u32 timesHit, RuleState, in snapshot ID order
+//   'K' ack:       | u32 highest migration batch applied
+//   'B' border:    | u16 part | u16 parts | encodeSnapshot payload, one ID-ordered slice of the set
+//   'F' forward:   | u16 count | count x (GameAction, u8 hops)
+// A node moves a client with 'R' | u32 IPv4 address | u16 port, both in network order.
+const uint8_t PACKET_MIGRATE = 'M';
+const uint8_t PACKET_MIGRATE_ACK = 'K';
+const uint8_t PACKET_BORDER = 'B';
+const uint8_t PACKET_FORWARD = 'F';
+const uint8_t PACKET_REDIRECT = 'R';
+const size_t PEER_HEADER_BYTES = 8;
+const size_t PEER_DATAGRAM_BYTES = 1400;      // under a 1500-byte MTU after IP and UDP headers
+const size_t SNAPSHOT_HEADER_MAX_BYTES = 16;  // version and three varints, plus the flag byte rounding
+const size_t SNAPSHOT_ENTITY_MAX_BYTES = 15;  // full snapshot: ID gap varint, flag bit, three 16-bit zigzags
+const size_t MIGRATE_HEADER_BYTES = 10;
+const size_t MIGRATE_RECORD_BYTES = 28 + sizeof(RuleState);
+const size_t MIGRATE_BATCH =               // entities per migration datagram
+    (PEER_DATAGRAM_BYTES - PEER_HEADER_BYTES - MIGRATE_HEADER_BYTES - SNAPSHOT_HEADER_MAX_BYTES) / (MIGRATE_RECORD_BYTES + SNAPSHOT_ENTITY_MAX_BYTES);
+const uint32_t MIGRATE_WINDOW = 32;        // unacknowledged batches per peer; later leavers wait
+const size_t BORDER_HEADER_BYTES = 4;
+const size_t BORDER_PER_PACKET =           // border entities per datagram
+    (PEER_DATAGRAM_BYTES - PEER_HEADER_BYTES - BORDER_HEADER_BYTES - SNAPSHOT_HEADER_MAX_BYTES) / SNAPSHOT_ENTITY_MAX_BYTES;
+const uint64_t MIGRATE_RETRY_TICKS = 6;    // an unacknowledged batch is resent this often
+const uint64_t BORDER_REFRESH_TICKS = 30;  // an unchanged border set is resent this often, in case one was lost
+const uint32_t BORDER_REORDER_TICKS = 64;  // an older border set is reordered within this; further back, the peer restarted
+const uint64_t REDIRECT_INTERVAL_TICKS = 30; // a client still sending to the wrong node is told again this often
+const size_t FORWARD_WIRE_BYTES = sizeof(GameAction) + 1;
+const size_t FORWARDS_PER_PACKET = 80; // keeps forward datagrams under a 1500-byte MTU, like action datagrams
+const uint8_t FORWARD_SPAWN = 0x80;  // hops flag: the sender never had the entity and guessed its spawn node
+const uint8_t MAX_FORWARD_HOPS = 4;
+const size_t REDIRECT_BYTES = 7;
+const uint16_t NO_NODE = UINT16_MAX;
+
+class ClusterNode {
+public:
+    struct Outgoing { uint16_t node; uint32_t offset, bytes; };
+private:
+    struct Batch {
+        std::vector<uint8_t> bytes;
+        uint64_t due = 0; // tick to (re)send it at
+    };
+    struct Peer {
+        uint32_t nextBatch = 1, acked = 0; // migration batches to the peer, numbered from 1
+        Batch window[MIGRATE_WINDOW];      // unacknowledged ones, by batch % MIGRATE_WINDOW
+        std::vector<EntityRecord> leaving; // handed to the peer, waiting for room in the window
+        std::vector<QueuedAction> forwards;
+        std::vector<uint8_t> forwardHops;
+        std::vector<QuantEntity> border;   // the last border set sent
+        uint64_t borderTick = 0;
+        uint32_t applied = 0;              // highest batch from the peer applied here
+        bool ackDue = false;
+        std::vector<QuantEntity> ghosts;   // the peer's last complete border set, sorted by ID
+        uint32_t ghostTick = 0;
+        std::vector<QuantEntity> partial;  // parts of the set being assembled
+        std::vector<uint8_t> partSeen;
+        uint32_t partTick = 0, partsLeft = 0;
+    };
+    std::vector<Peer> peers;
+    uint32_t nodes = 1, self = 0;
+    uint64_t tick = 0;
+    std::vector<uint16_t> away;           // client ID -> node it was handed to, NO_NODE if it never left
+    std::vector<uint64_t> redirectedTick; // client ID -> tick of its last redirect, plus one
+    std::vector<uint8_t> outBytes;
+    std::vector<Outgoing> out;
+    std::vector<std::pair<uint32_t, uint16_t>> redirects; // client, node
+    std::vector<EntityRecord> landed;     // migrated in, applied at the start of the next tick
+    std::vector<QueuedAction> inbound;    // forwarded here, routed with the next tick
+    std::vector<uint8_t> inboundHops;
+    std::vector<QuantEntity> scratch;
+
+    uint8_t* beginPacket(uint8_t type, uint32_t node) {
+        size_t off = outBytes.size();
+        outBytes.resize(off + MAX_DATAGRAM);
+        out.push_back({ uint16_t(node), uint32_t(off), 0 });
+        uint8_t* p = outBytes.data() + off;
+        p[0] = type; p[1] = WIRE_VERSION; putU16(p + 2, uint16_t(self)); putU32(p + 4, uint32_t(tick));
+        return p;
+    }
+    void endPacket(size_t bytes) {
+        out.back().bytes = uint32_t(bytes);
+        largestDatagram = std::max(largestDatagram, bytes);
+        outBytes.resize(out.back().offset + bytes);
+    }
+    void redirect(uint32_t id, uint16_t node, bool force) {
+        if (id >= redirectedTick.size()) redirectedTick.resize(std::max(size_t(id) + 1, 2 * redirectedTick.size()), 0);
+        if (!force && redirectedTick[id] && tick + 1 < redirectedTick[id] + REDIRECT_INTERVAL_TICKS) return;
+        redirectedTick[id] = tick + 1;
+        redirects.push_back({ id, node });
+    }
+    // Encodes rs (sorted by ID) as the peer's next migration batch
+    void encodeBatch(Peer& peer, const EntityRecord* rs, size_t n) {
+        uint32_t b = peer.nextBatch++;
+        Batch& slot = peer.window[b % MIGRATE_WINDOW];
+        slot.bytes.resize(PEER_DATAGRAM_BYTES);
+        slot.due = tick;
+        for (size_t i = 0; i < n; i++) scratch[i] = quantizeEntity(rs[i].id, rs[i].x, rs[i].y, rs[i].z);
+        uint8_t* p = slot.bytes.data();
+        uint8_t* body = p + PEER_HEADER_BYTES;
+        SnapshotSpan span = { b, scratch.data(), uint32_t(n) };
+        size_t snap = encodeSnapshot(span, nullptr, body + MIGRATE_HEADER_BYTES, PEER_DATAGRAM_BYTES - PEER_HEADER_BYTES - MIGRATE_HEADER_BYTES);
+        p[0] = PACKET_MIGRATE; p[1] = WIRE_VERSION; putU16(p + 2, uint16_t(self)); putU32(p + 4, uint32_t(tick));
+        putU32(body, b); putU16(body + 4, uint16_t(n)); putU32(body + 6, uint32_t(snap));
+        uint8_t* rec = body + MIGRATE_HEADER_BYTES + snap;
+        for (size_t i = 0; i < n; i++, rec += MIGRATE_RECORD_BYTES) {
+            const EntityRecord& r = rs[i];
+            float f[4] = { r.x, r.y, r.z, r.vz };
+            std::memcpy(rec, f, 16);
+            std::memcpy(rec + 16, &r.penalty, 4);
+            putU32(rec + 20, r.lastInput);
+            putU32(rec + 24, r.timesHit);
+            std::memcpy(rec + 28, &r.rules, sizeof(RuleState));
+        }
+        slot.bytes.resize(size_t(rec - p));
+        migrationBatches++;
+    }
+    bool receiveMigration(Peer& peer, const uint8_t* p, size_t n) {
+        if (n < MIGRATE_HEADER_BYTES) return false;
+        uint32_t b = getU32(p);
+        size_t count = getU16(p + 4), snap = getU32(p + 6);
+        if (b <= peer.applied) { peer.ackDue = true; return true; } // a resend of one already applied
+        if (b != peer.applied + 1) return true;                     // wait for the resend of the one missed
+        if (snap > n - MIGRATE_HEADER_BYTES || count > MIGRATE_BATCH ||
+            n - MIGRATE_HEADER_BYTES - snap != count * MIGRATE_RECORD_BYTES) return false;
+        uint32_t got = 0, seq = 0;
+        if (!decodeSnapshot(p + MIGRATE_HEADER_BYTES, snap, nullptr, scratch.data(), uint32_t(scratch.size()), got, seq) || got != count)
+            return false;
+        const uint8_t* rec = p + MIGRATE_HEADER_BYTES + snap;
+        size_t first = landed.size();
+        for (size_t i = 0; i < count; i++, rec += MIGRATE_RECORD_BYTES) {
+            EntityRecord r;
+            r.id = scratch[i].id;
+            float f[4];
+            std::memcpy(f, rec, 16);
+            r.x = f[0]; r.y = f[1]; r.z = f[2]; r.vz = f[3];
+            std::memcpy(&r.penalty, rec + 16, 4);
+            r.lastInput = getU32(rec + 20);
+            r.timesHit = getU32(rec + 24);
+            std::memcpy(&r.rules, rec + 28, sizeof(RuleState));
+            bool sane = r.id != 0 && r.id < MAX_REMOTE_CLIENT_ID && std::isfinite(r.z) && std::isfinite(r.vz) &&
+                        inWorld(world, r.x, r.y) && quantizeEntity(r.id, r.x, r.y, r.z).sameState(scratch[i]);
+            if (!sane) { landed.resize(first); return false; }
+            landed.push_back(r);
+        }
+        peer.applied = b;
+        peer.ackDue = true;
+        migrationsIn += count;
+        return true;
+    }
+    // The entities within band of the edge shared with node k, if changed, in
+    // as many parts as it takes
+    void sendBorder(uint32_t k, const EntityStore& st, float band) {
+        Peer& peer = peers[k];
+        float edge = stripLeft(k < self ? self : self + 1);
+        size_t n = 0;
+        for (size_t i = 0; i < st.size() && n < scratch.size(); i++)
+            if (st.alive[i] && std::fabs(st.x[i] - edge) <= band) scratch[n++] = quantizeEntity(st.ids[i], st.x[i], st.y[i], st.z[i]);
+        std::sort(scratch.begin(), scratch.begin() + n, [](const QuantEntity& a, const QuantEntity& b) { return a.id < b.id; });
+        bool same = peer.border.size() == n && std::equal(scratch.begin(), scratch.begin() + n, peer.border.begin(),
+                                                          [](const QuantEntity& a, const QuantEntity& b) { return a.id == b.id && a.sameState(b); });
+        if (same && tick < peer.borderTick + BORDER_REFRESH_TICKS) return;
+        size_t parts = std::max<size_t>(1, (n + BORDER_PER_PACKET - 1) / BORDER_PER_PACKET);
+        size_t firstOut = out.size(), total = 0;
+        for (size_t part = 0; part < parts; part++) {
+            size_t first = part * BORDER_PER_PACKET, m = std::min(BORDER_PER_PACKET, n - first);
+            uint8_t* p = beginPacket(PACKET_BORDER, k);
+            putU16(p + PEER_HEADER_BYTES, uint16_t(part)); putU16(p + PEER_HEADER_BYTES + 2, uint16_t(parts));
+            SnapshotSpan span = { uint32_t(tick), scratch.data() + first, uint32_t(m) };
+            size_t bytes = encodeSnapshot(span, nullptr, p + PEER_HEADER_BYTES + BORDER_HEADER_BYTES,
+                                          PEER_DATAGRAM_BYTES - PEER_HEADER_BYTES - BORDER_HEADER_BYTES);
+            if (!bytes) { // drop the whole set rather than send part of it
+                outBytes.resize(out[firstOut].offset);
+                out.resize(firstOut);
+                borderOverflows++;
+                return;
+            }
+            endPacket(PEER_HEADER_BYTES + BORDER_HEADER_BYTES + bytes);
+            total += PEER_HEADER_BYTES + BORDER_HEADER_BYTES + bytes;
+        }
+        peer.border.assign(scratch.begin(), scratch.begin() + n);
+        peer.borderTick = tick;
+        borderUpdates++;
+        borderDatagrams += parts;
+        borderBytes += total;
+    }
+
+public:
+    uint64_t migrationsOut = 0, migrationsIn = 0, migrationBatches = 0, migrationResends = 0;
+    uint64_t forwardsOut = 0, forwardsIn = 0, forwardsDropped = 0, redirectsQueued = 0;
+    uint64_t borderUpdates = 0, borderDatagrams = 0, borderBytes = 0, borderOverflows = 0, peerMalformed = 0, peerRestarts = 0;
+    size_t largestDatagram = 0;
+
+    void configure(uint32_t node, uint32_t count) {
+        self = node; nodes = count;
+        peers = std::vector<Peer>(count);
+        scratch.resize(std::max(MIGRATE_BATCH, MAX_DATAGRAM / 4)); // more than one datagram can hold
+        outBytes.reserve(size_t(count) * 4 * MAX_DATAGRAM);
+        for (Peer& p : peers) for (Batch& b : p.window) b.bytes.reserve(PEER_DATAGRAM_BYTES);
+    }
+    bool active() const { return nodes > 1; }
+    uint32_t node() const { return self; }
+    uint32_t size() const { return nodes; }
+    // Left edge of node k's strip; stripLeft(nodes) is the world's right edge
+    float stripLeft(uint32_t k) const { return world.extentX() * (2.0f * float(k) / float(nodes) - 1.0f); }
+    float stripWidth() const { return stripLeft(self + 1) - stripLeft(self); }
+    uint32_t nodeOf(float x) const {
+        int n = int(nodes);
+        int k = int((x + world.extentX()) * float(n) / (2.0f * world.extentX()));
+        return uint32_t(k < 0 ? 0 : k >= n ? n - 1 : k);
+    }
+    bool holds(float x) const { return nodes == 1 || nodeOf(x) == self; }
+    bool spawnsHere(uint32_t id) const { float x, y; spawnPoint(id, x, y); return holds(x); }
+
+    // Decides where an action is simulated. here says whether its entity is
+    // live on this node; hops is 0 for an action straight from a client, else
+    // the forwarding byte it came with. False means it was queued for the
+    // node that has the entity instead.
+    bool admit(const QueuedAction& q, uint8_t hops, bool here) {
+        if (here) return true;
+        uint32_t id = q.action.clientID;
+        uint16_t to = id < away.size() ? away[id] : NO_NODE;
+        bool guess = to == NO_NODE;
+        if (guess) {
+            // Never here: it starts on its spawn point's node. A sender that
+            // thought it lived here is ahead of the migration bringing it.
+            if (hops && !(hops & FORWARD_SPAWN)) { forwardsDropped++; return false; }
+            float x, y;
+            spawnPoint(id, x, y);
+            to = uint16_t(nodeOf(x));
+            if (to == self) return true;
+        }
+        uint8_t n = uint8_t((hops & ~FORWARD_SPAWN) + 1);
+        if (n > MAX_FORWARD_HOPS) { forwardsDropped++; return false; }
+        peers[to].forwards.push_back(q);
+        peers[to].forwardHops.push_back(uint8_t(n | (guess ? FORWARD_SPAWN : 0)));
+        forwardsOut++;
+        if (!hops) redirect(id, to, false);
+        return false;
+    }
+    // Hands an entity that left this node's strip to the node it entered
+    void migrate(const EntityRecord& r) {
+        uint16_t to = uint16_t(nodeOf(r.x));
+        if (r.id >= away.size()) away.resize(std::max(size_t(r.id) + 1, 2 * away.size()), NO_NODE);
+        away[r.id] = to;
+        peers[to].leaving.push_back(r);
+        redirect(r.id, to, true);
+        migrationsOut++;
+    }
+
+    void beginTick(uint64_t t) { tick = t; }
+    // What receive() took in since the last tick: the caller adopts the
+    // arrivals and routes the forwarded actions, then clears both
+    const std::vector<EntityRecord>& arrivals() const { return landed; }
+    size_t forwardedCount() const { return inbound.size(); }
+    const QueuedAction& forwarded(size_t i) const { return inbound[i]; }
+    uint8_t forwardedHops(size_t i) const { return inboundHops[i]; }
+    void clearArrivals() {
+        landed.clear();
+        inbound.clear();
+        inboundHops.clear();
+    }
+
+    // Ghosts within radius of (x, y), or all of them
+    template<typename Fn>
+    void forEachGhost(float x, float y, float radius, bool all, Fn fn) const {
+        float e = quantExtent(), r2 = radius * radius;
+        for (const Peer& p : peers)
+            for (const QuantEntity& g : p.ghosts) {
+                float dx = dequantize(g.x, e) - x, dy = dequantize(g.y, e) - y;
+                if (all || dx * dx + dy * dy <= r2) fn(g);
+            }
+    }
+    size_t ghostCount() const { size_t n = 0; for (const Peer& p : peers) n += p.ghosts.size(); return n; }
+
+    // Queues this tick's peer traffic: migration batches (new, and any due
+    // for a resend), acks, forwarded actions and border sets from st
+    void endTick(const EntityStore& st, float band) {
+        for (uint32_t k = 0; k < nodes; k++) {
+            if (k == self) continue;
+            Peer& peer = peers[k];
+            std::sort(peer.leaving.begin(), peer.leaving.end(), [](const EntityRecord& a, const EntityRecord& b) { return a.id < b.id; });
+            size_t taken = 0;
+            while (taken < peer.leaving.size() && peer.nextBatch - 1 - peer.acked < MIGRATE_WINDOW) {
+                size_t n = std::min(MIGRATE_BATCH, peer.leaving.size() - taken);
+                encodeBatch(peer, peer.leaving.data() + taken, n);
+                taken += n;
+            }
+            peer.leaving.erase(peer.leaving.begin(), peer.leaving.begin() + taken);
+            for (uint32_t b = peer.acked + 1; b < peer.nextBatch; b++) {
+                Batch& slot = peer.window[b % MIGRATE_WINDOW];
+                if (tick < slot.due) continue;
+                if (slot.due != tick) migrationResends++;
+                uint8_t* p = beginPacket(PACKET_MIGRATE, k);
+                std::memcpy(p, slot.bytes.data(), slot.bytes.size());
+                endPacket(slot.bytes.size());
+                slot.due = tick + MIGRATE_RETRY_TICKS;
+            }
+            if (peer.ackDue) {
+                uint8_t* p = beginPacket(PACKET_MIGRATE_ACK, k);
+                putU32(p + PEER_HEADER_BYTES, peer.applied);
+                endPacket(PEER_HEADER_BYTES + 4);
+                peer.ackDue = false;
+            }
+            for (size_t i = 0; i < peer.forwards.size(); i += FORWARDS_PER_PACKET) {
+                size_t n = std::min(FORWARDS_PER_PACKET, peer.forwards.size() - i);
+                uint8_t* p = beginPacket(PACKET_FORWARD, k);
+                putU16(p + PEER_HEADER_BYTES, uint16_t(n));
+                uint8_t* f = p + PEER_HEADER_BYTES + 2;
+                for (size_t j = 0; j < n; j++, f += FORWARD_WIRE_BYTES) {
+                    std::memcpy(f, &peer.forwards[i + j].action, sizeof(GameAction));
+                    f[sizeof(GameAction)] = peer.forwardHops[i + j];
+                }
+                endPacket(size_t(f - p));
+            }
+            peer.forwards.clear();
+            peer.forwardHops.clear();
+            if (k + 1 == self || k == self + 1) sendBorder(k, st, band);
+        }
+    }
+
+    // Takes one peer datagram that the transport has matched to node `from`'s
+    // address. Returns false when it is malformed.
+    bool receive(const uint8_t* p, size_t n, uint32_t from) {
+        if (n < PEER_HEADER_BYTES || p[1] != WIRE_VERSION || from == self || getU16(p + 2) != from) return false;
+        Peer& peer = peers[from];
+        uint32_t sentTick = getU32(p + 4);
+        const uint8_t* body = p + PEER_HEADER_BYTES;
+        size_t len = n - PEER_HEADER_BYTES;
+        switch (p[0]) {
+        case PACKET_MIGRATE:
+            return receiveMigration(peer, body, len);
+        case PACKET_MIGRATE_ACK:
+            if (len < 4) return false;
+            peer.acked = std::max(peer.acked, std::min(getU32(body), peer.nextBatch - 1));
+            return true;
+        case PACKET_BORDER: {
+            if (len < BORDER_HEADER_BYTES) return false;
+            uint32_t part = getU16(body), parts = getU16(body + 2);
+            uint32_t count = 0, seq = 0;
+            if (part >= parts || !decodeSnapshot(body + BORDER_HEADER_BYTES, len - BORDER_HEADER_BYTES, nullptr,
+                                                 scratch.data(), uint32_t(scratch.size()), count, seq)) return false;
+            if (sentTick + BORDER_REORDER_TICKS < std::max(peer.ghostTick, peer.partTick)) {
+                // The peer's tick went back, so it restarted or resumed from an
+                // older checkpoint: its sets count from here, not the old high-water mark
+                peer.ghostTick = peer.partTick = peer.partsLeft = 0;
+                peer.partSeen.clear();
+                peer.partial.clear();
+                peerRestarts++;
+            }
+            if (peer.ghostTick && sentTick <= peer.ghostTick) return true; // reordered behind a newer one
+            if (sentTick < peer.partTick) return true;                     // a part of a set already superseded
+            if (sentTick != peer.partTick || parts != peer.partSeen.size()) {
+                peer.partTick = sentTick;
+                peer.partial.clear();
+                peer.partSeen.assign(parts, 0);
+                peer.partsLeft = parts;
+            }
+            if (peer.partSeen[part]) return true;
+            if (peer.partial.size() + count > scratch.size()) return false;
+            peer.partSeen[part] = 1;
+            peer.partial.insert(peer.partial.end(), scratch.begin(), scratch.begin() + count);
+            if (--peer.partsLeft) return true;
+            std::sort(peer.partial.begin(), peer.partial.end(), [](const QuantEntity& a, const QuantEntity& b) { return a.id < b.id; });
+            peer.ghosts.swap(peer.partial);
+            peer.partial.clear();
+            peer.ghostTick = sentTick;
+            return true;
+        }
+        case PACKET_FORWARD: {
+            if (len < 2) return false;
+            size_t count = getU16(body);
+            if (len - 2 < count * FORWARD_WIRE_BYTES) return false;
+            for (size_t i = 0; i < count; i++) {
+                GameAction a;
+                std::memcpy(&a, body + 2 + i * FORWARD_WIRE_BYTES, sizeof(GameAction));
+                if (a.clientID == 0 || a.clientID >= MAX_REMOTE_CLIENT_ID || a.kind >= ActionKind::Count) return false;
+            }
+            int64_t now = nowNs(); // stamped on arrival, like a client's
+            for (size_t i = 0; i < count && inbound.size() < MAX_PENDING_ACTIONS; i++) {
+                const uint8_t* f = body + 2 + i * FORWARD_WIRE_BYTES;
+                QueuedAction q;
+                std::memcpy(&q.action, f, sizeof(GameAction));
+                q.submitNs = now;
+                inbound.push_back(q);
+                inboundHops.push_back(f[sizeof(GameAction)]);
+                forwardsIn++;
+            }
+            return true;
+        }
+        }
+        return false;
+    }
+
+    // Traffic queued by endTick, for the transport to send and then clear
+    const std::vector<Outgoing>& outgoing() const { return out; }
+    const uint8_t* outgoingBytes() const { return outBytes.data(); }
+    const std::vector<std::pair<uint32_t, uint16_t>>& redirectsDue() const { return redirects; }
+    void clearOutgoing() {
+        redirectsQueued += redirects.size();
+        out.clear();
+        outBytes.clear();
+        redirects.clear();
+    }
+    void appendMetrics(std::vector<struct Metric>& m) const;
+};
+ClusterNode cluster; // one node, and inactive, unless --cluster is given
+std::atomic<uint64_t> clientRedirects{ 0 }; // redirects UDP clients followed to another node
+
+#ifdef HAVE_UDP_TRANSPORT
+// Preallocated datagram slots for one recvmmsg/sendmmsg call
+struct DatagramBatch {
+    std::vector<uint8_t> storage;
+    std::vector<mmsghdr> msgs;
+    std::vector<iovec> iovs;
+    std::vector<sockaddr_in> addrs;
+
+    explicit DatagramBatch(size_t slotBytes) : storage(UDP_BATCH * slotBytes), msgs(UDP_BATCH), iovs(UDP_BATCH), addrs(UDP_BATCH) {
+        for (size_t i = 0; i < UDP_BATCH; i++) {
+            iovs[i].iov_base = storage.data() + i * slotBytes;
+            iovs[i].iov_len = slotBytes;
+        }
+        reset(slotBytes);
+    }
+    void reset(size_t slotBytes) {
+        std::memset(msgs.data(), 0, msgs.size() * sizeof(mmsghdr));
+        for (size_t i = 0; i < UDP_BATCH; i++) {
+            iovs[i].iov_len = slotBytes;
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = &addrs[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        }
+    }
+    uint8_t* slot(size_t i) { return static_cast<uint8_t*>(iovs[i].iov_base); }
+};
+
+// Sends out[0, count) with as few sendmmsg calls as the kernel allows; drops on error
+inline void sendBatch(int fd, DatagramBatch& out, size_t count, bool connected) {
+    for (size_t i = 0; i < count; i++) if (connected) { out.msgs[i].msg_hdr.msg_name = nullptr; out.msgs[i].msg_hdr.msg_namelen = 0; }
+    size_t sent = 0;
+    while (sent < count) {
+        int r = sendmmsg(fd, out.msgs.data() + sent, unsigned(count - sent), 0);
+        if (r < 0) { if (errno == EINTR) continue; break; }
+        sent += size_t(r);
+    }
+}
+
+class UdpServerTransport : public ServerTransport {
+    int fd = -1;
+    DatagramBatch in, out;
+    size_t outCount = 0;
+    std::vector<QueuedAction> staged;
+    size_t stagedPos = 0, stagedCount = 0;
+    std::vector<sockaddr_in> clientAddr; // by client ID
+    std::vector<uint8_t> hasAddr;
+    std::vector<uint32_t> acks;
+    ClusterNode* clusterNode = nullptr;
+    std::vector<sockaddr_in> peerAddr; // by node
+    uint64_t packetsIn = 0, bytesIn = 0, malformed = 0, snapshotsOut = 0, snapshotsDropped = 0, redirectsSent = 0;
+
+    static bool sameAddr(const sockaddr_in& a, const sockaddr_in& b) { return a.sin_addr.s_addr == b.sin_addr.s_addr && a.sin_port == b.sin_port; }
+    // Hands a datagram from another node to the cluster; false if it isn't one
+    bool fromPeer(const uint8_t* p, size_t len, const sockaddr_in& from) {
+        if (!clusterNode || len < PEER_HEADER_BYTES) return false;
+        uint16_t node = getU16(p + 2);
+        if (node >= peerAddr.size() || !sameAddr(peerAddr[node], from)) return false;
+        if (!clusterNode->receive(p, len, node)) clusterNode->peerMalformed++;
+        return true;
+    }
+    // Returns the datagrams read
+    int pull() {
+        stagedPos = stagedCount = 0;
+        in.reset(MAX_DATAGRAM);
+        int r = recvmmsg(fd, in.msgs.data(), unsigned(UDP_BATCH), MSG_DONTWAIT, nullptr);
+        if (r <= 0) return 0;
+        int64_t now = nowNs(); // client clocks aren't comparable across hosts, so stamp on arrival
+        for (int m = 0; m < r; m++) {
+            const uint8_t* p = in.slot(size_t(m));
+            size_t len = in.msgs[m].msg_len;
+            packetsIn++; bytesIn += len;
+            if (len && p[0] != PACKET_ACTIONS && fromPeer(p, len, in.addrs[size_t(m)])) continue;
+            if (len < ACTION_HEADER_BYTES || p[0] != PACKET_ACTIONS || p[1] != WIRE_VERSION) { malformed++; continue; }
+            size_t count = size_t(p[2]) | size_t(p[3]) << 8;
+            uint32_t client = getU32(p + 4);
+            if (count > MAX_ACTIONS_PER_PACKET || len < ACTION_HEADER_BYTES + count * ACTION_WIRE_BYTES ||
+                client == 0 || client >= MAX_REMOTE_CLIENT_ID) { malformed++; continue; }
+            if (client >= clientAddr.size()) { clientAddr.resize(client + 1); hasAddr.resize(client + 1, 0); acks.resize(client + 1, 0); }
+            clientAddr[client] = in.addrs[size_t(m)]; hasAddr[client] = 1;
+            uint32_t ack = getU32(p + 8);
+            if (ack > acks[client]) acks[client] = ack;
+            for (size_t i = 0; i < count; i++) {
+                QueuedAction& q = staged[stagedCount];
+                std::memcpy(&q.action, p + ACTION_HEADER_BYTES + i * ACTION_WIRE_BYTES, sizeof(GameAction));
+                if (q.action.clientID != client || q.action.kind >= ActionKind::Count) { malformed++; continue; }
+                q.submitNs = now;
+                stagedCount++;
+            }
+        }
+        return r;
+    }
+    // Next free slot of the outgoing batch, n bytes long, addressed to `to`.
+    // A full batch goes out first.
+    uint8_t* stage(const sockaddr_in& to, size_t n) {
+        if (outCount == UDP_BATCH) { sendBatch(fd, out, outCount, false); outCount = 0; }
+        if (outCount == 0) out.reset(MAX_DATAGRAM);
+        uint8_t* p = out.slot(outCount);
+        out.iovs[outCount].iov_len = n;
+        out.addrs[outCount] = to;
+        outCount++;
+        return p;
+    }
+    // The cluster's traffic from this tick: peer datagrams, and redirects for
+    // clients whose entity lives on another node
+    void sendClusterTraffic() {
+        const ClusterNode& c = *clusterNode;
+        for (const ClusterNode::Outgoing& o : c.outgoing())
+            std::memcpy(stage(peerAddr[o.node], o.bytes), c.outgoingBytes() + o.offset, o.bytes);
+        for (const auto& r : c.redirectsDue()) {
+            uint32_t client = r.first;
+            if (client >= hasAddr.size() || !hasAddr[client]) continue;
+            uint8_t* p = stage(clientAddr[client], REDIRECT_BYTES);
+            p[0] = PACKET_REDIRECT;
+            std::memcpy(p + 1, &peerAddr[r.second].sin_addr.s_addr, 4);
+            std::memcpy(p + 5, &peerAddr[r.second].sin_port, 2);
+            acks[client] = 0; // the client starts over with the node it moves to
+            redirectsSent++;
+        }
+        clusterNode->clearOutgoing();
+    }
+public:
+    explicit UdpServerTransport(int port) : in(MAX_DATAGRAM), out(MAX_DATAGRAM), staged(UDP_BATCH * MAX_ACTIONS_PER_PACKET) {
+        fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd < 0) return;
+        int buf = 8 << 20;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buf, sizeof(buf));
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &buf, sizeof(buf));
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(uint16_t(port));
+        if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) { ::close(fd); fd = -1; }
+    }
+    ~UdpServerTransport() override { if (fd >= 0) ::close(fd); }
+    bool ok() const { return fd >= 0; }
+    // Peer traffic for c; addrs holds every node's address, this one's included
+    void attachCluster(ClusterNode& c, const std::vector<sockaddr_in>& addrs) { clusterNode = &c; peerAddr = addrs; }
+
+    size_t receive(QueuedAction* dst, size_t max) override {
+        // A batch of nothing but peer traffic doesn't end the drain
+        if (stagedPos == stagedCount) while (pull() == int(UDP_BATCH) && stagedCount == 0) {}
+        size_t n = std::min(max, stagedCount - stagedPos);
+        std::copy(staged.begin() + stagedPos, staged.begin() + stagedPos + n, dst);
+        stagedPos += n;
+        return n;
+    }
+    bool remote() const override { return true; }
+    uint32_t ackedSnapshot(uint32_t client) const override { return client < acks.size() ? acks[client] : 0; }
+    void sendSnapshot(uint32_t client, uint32_t inputAck, const uint8_t* data, size_t n) override {
+        if (client >= hasAddr.size() || !hasAddr[client] || n + SNAPSHOT_HEADER_BYTES > MAX_DATAGRAM) { snapshotsDropped++; return; }
+        uint8_t* p = stage(clientAddr[client], n + SNAPSHOT_HEADER_BYTES);
+        p[0] = PACKET_SNAPSHOT;
+        putU32(p + 1, inputAck);
+        std::memcpy(p + SNAPSHOT_HEADER_BYTES, data, n);
+        snapshotsOut++;
+    }
+    void flush() override {
+        if (clusterNode) sendClusterTraffic();
+        if (outCount) sendBatch(fd, out, outCount, false);
+        outCount = 0;
+    }
+    void appendMetrics(std::vector<Metric>& m) const override;
+};
+
+class UdpClientTransport : public ClientTransport {
+    int fd = -1;
+    sockaddr_in server = {}; // the node the client talks to; a redirect moves it
+    uint32_t clientID;
+    uint32_t ack = 0;
+    DatagramBatch out, in;
+    size_t outCount = 0, outActions = 0; // packets in use, actions in the last one
+    std::vector<QuantEntity> baselines[SNAPSHOT_RING];
+    uint32_t baselineSeq[SNAPSHOT_RING] = {};
+    std::vector<QuantEntity> decoded;
+
+    static bool peekSeqs(const uint8_t* p, size_t n, uint32_t& seq, uint32_t& baseSeq) {
+        ByteReader r(p, n);
+        if (r.get() != WIRE_VERSION) return false;
+        seq = r.varint();
+        baseSeq = r.varint();
+        return r.ok();
+    }
+public:
+    UdpClientTransport(const std::string& host, int port, uint32_t id)
+        : clientID(id), out(ACTION_HEADER_BYTES + MAX_ACTIONS_PER_PACKET * ACTION_WIRE_BYTES), in(MAX_DATAGRAM), decoded(8192) {
+        addrinfo hints = {}, *res = nullptr;
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_DGRAM;
+        if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res) != 0 || !res) return;
+        fd = socket(AF_INET, SOCK_DGRAM, 0);
+        std::memcpy(&server, res->ai_addr, sizeof(server));
+        if (fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) < 0) { ::close(fd); fd = -1; }
+        freeaddrinfo(res);
+    }
+    ~UdpClientTransport() override { if (fd >= 0) ::close(fd); }
+    // Reconnects to the node named by a redirect. Its snapshot numbering is
+    // its own, so the baselines from the old node are dropped.
+    void follow(const uint8_t* p) {
+        sockaddr_in to = {};
+        to.sin_family = AF_INET;
+        std::memcpy(&to.sin_addr.s_addr, p + 1, 4);
+        std::memcpy(&to.sin_port, p + 5, 2);
+        if (connect(fd, reinterpret_cast<sockaddr*>(&to), sizeof(to)) < 0) return;
+        server = to;
+        ack = 0;
+        for (uint32_t& s : baselineSeq) s = 0;
+        clientRedirects.fetch_add(1, std::memory_order_relaxed);
+    }
+    bool ok() const { return fd >= 0; }
+
+    bool send(const GameAction& a, int64_t submitNs) override {
+        if (outCount == 0 || outActions == MAX_ACTIONS_PER_PACKET) {
+            if (outCount == UDP_BATCH) flush();
+            outCount++;
+            outActions = 0;
+        }
+        uint8_t* p = out.slot(outCount - 1);
+        std::memcpy(p + ACTION_HEADER_BYTES + outActions * ACTION_WIRE_BYTES, &a, sizeof(GameAction));
+        std::memcpy(p + ACTION_HEADER_BYTES + outActions * ACTION_WIRE_BYTES + sizeof(GameAction), &submitNs, sizeof(int64_t));
+        outActions++;
+        return true;
+    }
+    void flush() override {
+        if (outCount == 0 || fd < 0) { outCount = 0; return; }
+        for (size_t i = 0; i < outCount; i++) {
+            size_t count = i + 1 == outCount ? outActions : MAX_ACTIONS_PER_PACKET;
+            uint8_t* p = out.slot(i);
+            p[0] = PACKET_ACTIONS; p[1] = WIRE_VERSION; p[2] = uint8_t(count); p[3] = uint8_t(count >> 8);
+            putU32(p + 4, clientID);
+            putU32(p + 8, ack);
+            out.iovs[i].iov_len = ACTION_HEADER_BYTES + count * ACTION_WIRE_BYTES;
+        }
+        sendBatch(fd, out, outCount, true);
+        outCount = outActions = 0;
+    }
+    bool poll(float& x, float& y, float& z, uint32_t& inputAck) override {
+        if (fd < 0) return false;
+        bool updated = false;
+        for (;;) {
+            in.reset(MAX_DATAGRAM);
+            int r = recvmmsg(fd, in.msgs.data(), unsigned(UDP_BATCH), MSG_DONTWAIT, nullptr);
+            if (r <= 0) break;
+            for (int m = 0; m < r; m++) {
+                const uint8_t* p = in.slot(size_t(m));
+                size_t len = in.msgs[m].msg_len;
+                uint32_t seq, baseSeq;
+                const sockaddr_in& from = in.addrs[size_t(m)];
+                // Datagrams the old node sent before a redirect may still be queued
+                if (from.sin_addr.s_addr != server.sin_addr.s_addr || from.sin_port != server.sin_port) continue;
+                if (len == REDIRECT_BYTES && p[0] == PACKET_REDIRECT) { follow(p); continue; }
+                if (len <= SNAPSHOT_HEADER_BYTES || p[0] != PACKET_SNAPSHOT) continue;
+                const uint8_t* payload = p + SNAPSHOT_HEADER_BYTES;
+                size_t payloadLen = len - SNAPSHOT_HEADER_BYTES;
+                if (!peekSeqs(payload, payloadLen, seq, baseSeq) || seq <= ack) continue;
+                SnapshotSpan base = { 0, nullptr, 0 };
+                if (baseSeq != 0) {
+                    uint32_t s = baseSeq % SNAPSHOT_RING;
+                    if (baselineSeq[s] != baseSeq) continue; // baseline no longer held
+                    base = { baseSeq, baselines[s].data(), uint32_t(baselines[s].size()) };
+                }
+                uint32_t count = 0, decodedSeq = 0;
+                if (!decodeSnapshot(payload, payloadLen, baseSeq ? &base : nullptr, decoded.data(), uint32_t(decoded.size()), count, decodedSeq)) continue;
+                uint32_t slot = seq % SNAPSHOT_RING;
+                baselines[slot].assign(decoded.begin(), decoded.begin() + count);
+                baselineSeq[slot] = seq;
+                ack = seq;
+                auto it = std::lower_bound(decoded.begin(), decoded.begin() + count, clientID,
+                                           [](const QuantEntity& e, uint32_t id) { return e.id < id; });
+                if (it != decoded.begin() + count && it->id == clientID) {
+                    x = dequantize(it->x, quantExtent()); y = dequantize(it->y, quantExtent()); z = dequantize(it->z, Z_EXTENT);
+                    inputAck = getU32(p + 1);
+                    updated = true;
+                }
+            }
+        }
+        return updated;
+    }
+};
+#endif
+
+InProcessServerTransport inProcessServer(actionQueue);
+ServerTransport* serverTransport = &inProcessServer;
+std::string udpServerHost; // set when clients talk to the server over UDP
+int udpServerPort = 0;
+
+std::unique_ptr<ClientTransport> makeClientTransport(uint32_t id) {
+#ifdef HAVE_UDP_TRANSPORT
+    if (udpServerPort) {
+        std::unique_ptr<UdpClientTransport> t(new UdpClientTransport(udpServerHost, udpServerPort, id));
+        if (t->ok()) return t;
+        std::fprintf(stderr, "client %u: cannot reach %s:%d\n", id, udpServerHost.c_str(), udpServerPort);
+    }
+#endif
+    return std::unique_ptr<ClientTransport>(new InProcessClientTransport(actionQueue, id));
+}
+
+// Per-client-ID state handed between threads without stateMutex: each slot
+// has one writer and sits behind a sequence lock, so readers retry instead of
+// blocking. Sized once, before any client or server thread starts; IDs past
+// the end are dropped.
+class ClientStateTable {
+    struct Slot {
+        std::atomic<uint32_t> seq{ 0 }; // odd while the writer is mid-update
+        std::atomic<float> x{ 0.0f }, y{ 0.0f }, z{ 0.0f };
+        std::atomic<uint32_t> lastInput{ 0 };
+        std::atomic<uint64_t> version{ 0 }; // 0 = never published
+    };
+    std::unique_ptr<Slot[]> slots;
+    size_t count = 0;
+public:
+    void init(size_t ids) { slots.reset(new Slot[ids]); count = ids; }
+    size_t size() const { return count; }
+
+    // Only the slot's owner calls this; version must be nonzero
+    void publish(uint32_t id, float x, float y, float z, uint32_t lastInput, uint64_t version) {
+        if (id >= count) return;
+        Slot& s = slots[id];
+        uint32_t q = s.seq.load(std::memory_order_relaxed);
+        s.seq.store(q + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        s.x.store(x, std::memory_order_relaxed); s.y.store(y, std::memory_order_relaxed); s.z.store(z, std::memory_order_relaxed);
+        s.lastInput.store(lastInput, std::memory_order_relaxed);
+        s.version.store(version, std::memory_order_relaxed);
+        s.seq.store(q + 2, std::memory_order_release);
+    }
+    // A consistent copy of the slot; false when nothing was published for id
+    bool load(uint32_t id, float& x, float& y, float& z, uint32_t& lastInput, uint64_t& version) const {
+        if (id >= count) return false;
+        const Slot& s = slots[id];
+        for (;;) {
+            uint32_t q = s.seq.load(std::memory_order_acquire);
+            if (q & 1) { cpuRelax(); continue; }
+            version = s.version.load(std::memory_order_relaxed);
+            x = s.x.load(std::memory_order_relaxed); y = s.y.load(std::memory_order_relaxed); z = s.z.load(std::memory_order_relaxed);
+            lastInput = s.lastInput.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (s.seq.load(std::memory_order_relaxed) == q) return version != 0; // else torn by a publish
+        }
+    }
+    // Like load(), but false unless the slot changed since seenVersion, which it advances
+    bool poll(uint32_t id, uint64_t& seenVersion, float& x, float& y, float& z, uint32_t& lastInput) const {
+        float rx, ry, rz;
+        uint32_t ack;
+        uint64_t v;
+        if (!load(id, rx, ry, rz, ack, v) || v == seenVersion) return false;
+        seenVersion = v;
+        x = rx; y = ry; z = rz; lastInput = ack;
+        return true;
+    }
+};
+
+std::mutex stateMutex;
+EntityStore serverState;     // authoritative positions and penalties
+ClientStateTable clientReceived;  // what in-process clients have been told: authoritative state plus input acks, written by the tick
+ClientStateTable clientPredicted; // each client's own predicted position, written by its thread, drawn by the renderer
+
+// Adds a client's entity to serverState at its spawn point; one already
+// there stays where it is. Caller holds stateMutex.
+uint32_t joinEntity(uint32_t id) {
+    uint32_t idx = serverState.indexOf(id);
+    if (idx != NO_ENTITY && serverState.alive[idx]) return idx;
+    idx = serverState.add(id);
+    spawnPoint(id, serverState.x[idx], serverState.y[idx]);
+    return idx;
+}
+SpatialGrid spatialIndex(-5.5f, -5.5f, 1.0f, DEFAULT_WORLD_CELLS, DEFAULT_WORLD_CELLS); // authoritative, cells match the render grid
+
+// Resizes the world; only valid before any thread touches the simulation.
+// The spatial index keeps unit cells until that would pass about a million
+// of them, then coarsens so a large world doesn't cost a dense array per unit.
+void configureWorld(int cols, int rows) {
+    world = RuntimeWorld(cols, rows);
+    float cell = std::max(1.0f, std::ceil(std::sqrt(float(cols) * float(rows) / float(1 << 20))));
+    spatialIndex = SpatialGrid(-world.extentX() - 0.5f, -world.extentY() - 0.5f, cell,
+                               int(std::ceil(float(cols) / cell)), int(std::ceil(float(rows) / cell)));
+}
+
+// What one client has been sent: snapshots of the entities within aoiRadius of it
+struct ClientView {
+    std::vector<QuantEntity> sent[SNAPSHOT_RING]; // indexed by seq % SNAPSHOT_RING
+    uint32_t seq = 0;      // last snapshot sent, 0 = none yet
+    uint32_t ackedSeq = 0; // last snapshot the client acknowledged, 0 = none
+    uint64_t entitiesSent = 0, bytesSent = 0, naiveBytes = 0;
+    uint32_t lastEntities = 0, lastBytes = 0; // most recent tick only
+    uint32_t inputAck = 0; // input ack carried by the last snapshot
+
+    const std::vector<QuantEntity>& latest() const { return sent[seq % SNAPSHOT_RING]; }
+    // Grows every slot at once, with headroom, so a client whose interest set
+    // grows stops allocating after a few ticks instead of once per slot
+    void reserve(size_t n) {
+        size_t cap = n + n / 2 + 8;
+        for (auto& s : sent) s.reserve(cap);
+    }
+};
+std::vector<ClientView> clientViews; // indexed by client ID
+float aoiRadius = DEFAULT_AOI_RADIUS;
+uint64_t keyframesSent = 0, keyframeBytes = 0; // whole-world first snapshots for joining clients
+uint32_t snapshotAckLag = 0; // snapshots in flight before an ack comes back (one round trip)
+// Applied action plus the grid cell it landed in, for the renderer's trail
+struct HistoryEntry {
+    GameAction action;
+    int16_t gx, gy;
+};
+HistoryRing<HistoryEntry> actionHistory(HISTORY_LIMIT);
+std::atomic<bool> done{ false };
+uint64_t serverTick = 0;
+
+// Server-side benchmark metrics, written by serverThread only
+uint64_t actionsApplied = 0;
+uint64_t droppedThrottled = 0, droppedKicked = 0; // turned away at routing by the rule engine
+LatencyHistogram applyLatency; // client submit -> server apply, ns
+LatencyHistogram honestLatency; // the same, for clients above lastCheaterID only
+LatencyHistogram tickWakeLate;  // tick start past its due time, ns
+uint32_t lastCheaterID = 0;     // --cheaters runs clients up to this ID as cheaters
+struct DepthSample { double tMs; size_t depth; };
+std::vector<DepthSample> queueDepthSamples;
+const uint64_t ALLOC_WARMUP_TICKS = 60; // ticks for buffers to reach their steady-state size
+uint64_t tickHeapAllocs = 0, ticksWithHeapAllocs = 0, steadyTicks = 0; // tick thread, past the warmup
+const int DEPTH_SAMPLE_MS = 100;
+std::atomic<uint64_t> snapshotVersion{ 0 }; // bumped once per tick that changed any entity
+
+// Vertical motion. A Jump launches an entity that is on the ground at
+// JUMP_SPEED (one already in the air is accepted but doesn't move); every
+// tick after that gravity pulls it back down until it lands on z = 0.
+// vz is kept in units per tick, so a step is only adds and subtracts, which
+// no compiler can fuse differently on the scalar and vector paths.
+const float JUMP_SPEED = 6.0f; // units/s; apex about 0.9 units, 0.6 s in the air
+const float GRAVITY = 20.0f;   // units/s^2
+float tickSeconds = 1.0f / float(DEFAULT_TICK_HZ); // --tick-hz, or the replayed log's rate
+
+inline float jumpVelocity() { return JUMP_SPEED * tickSeconds; }
+inline float gravityStep() { return GRAVITY * tickSeconds * tickSeconds; }
+inline bool airborne(float z, float vz) { return z != 0.0f || vz != 0.0f; }
+// One tick of gravity g (gravityStep()). An entity at rest on the ground
+// stays exactly at rest, so the server can run it over every entity.
+inline void stepVertical(float& z, float& vz, float g) {
+    float v = vz - g;
+    float h = z + v;
+    bool landed = h <= 0.0f;
+    z = landed ? 0.0f : h;
+    vz = landed ? 0.0f : v;
+}
+
+// The server's apply and the client's prediction replay share these, so a
+// replayed input lands exactly where the server put it
+inline bool actionInBounds(float x, float y, const GameAction& a) {
+    float nx = x, ny = y;
+    if (a.kind == ActionKind::Move) { nx += a.deltaX(); ny += a.deltaY(); }
+    return inWorld(world, nx, ny);
+}
+inline void applyLegalAction(float& x, float& y, float& z, float& vz, const GameAction& a) {
+    if (a.kind == ActionKind::Move) { x += a.deltaX(); y += a.deltaY(); }
+    else if (a.kind == ActionKind::Jump && !airborne(z, vz)) vz = jumpVelocity();
+}
+// Returns false, leaving the state untouched, for an input the server would reject
+inline bool predictAction(float& x, float& y, float& z, float& vz, const GameAction& a) {
+    if (!actionInBounds(x, y, a)) return false;
+    applyLegalAction(x, y, z, vz, a);
+    return true;
+}
+
+// Batch gravity over SoA columns: one tick of stepVertical for n entities in
+// one pass, setting moved[i] when entity i was in the air and returning how
+// many still are. The scalar loop is the reference; the vector paths must
+// match it bit for bit, since clients predict with stepVertical itself.
+size_t integrateVerticalScalar(float* z, float* vz, uint8_t* moved, size_t n, float g) {
+    size_t up = 0;
+    for (size_t i = 0; i < n; i++) {
+        moved[i] = uint8_t(airborne(z[i], vz[i]));
+        stepVertical(z[i], vz[i], g);
+        up += z[i] != 0.0f;
+    }
+    return up;
+}
+
+#if defined(__AVX2__)
+size_t integrateVertical(float* z, float* vz, uint8_t* moved, size_t n, float g) {
+    const __m256 zero = _mm256_setzero_ps(), vg = _mm256_set1_ps(g);
+    size_t i = 0, up = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 z0 = _mm256_loadu_ps(z + i), v0 = _mm256_loadu_ps(vz + i);
+        int was = _mm256_movemask_ps(_mm256_or_ps(_mm256_cmp_ps(z0, zero, _CMP_NEQ_UQ), _mm256_cmp_ps(v0, zero, _CMP_NEQ_UQ)));
+        __m256 v = _mm256_sub_ps(v0, vg);
+        __m256 h = _mm256_add_ps(z0, v);
+        __m256 aloft = _mm256_cmp_ps(h, zero, _CMP_NLE_UQ); // !(h <= 0), as the scalar landed test
+        _mm256_storeu_ps(z + i, _mm256_and_ps(aloft, h));
+        _mm256_storeu_ps(vz + i, _mm256_and_ps(aloft, v));
+        int mask = _mm256_movemask_ps(aloft);
+        for (int k = 0; k < 8; k++) { moved[i + k] = uint8_t((was >> k) & 1); up += (mask >> k) & 1; }
+    }
+    return up + integrateVerticalScalar(z + i, vz + i, moved + i, n - i, g);
+}
+#elif defined(__SSE2__)
+size_t integrateVertical(float* z, float* vz, uint8_t* moved, size_t n, float g) {
+    const __m128 zero = _mm_setzero_ps(), vg = _mm_set1_ps(g);
+    size_t i = 0, up = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 z0 = _mm_loadu_ps(z + i), v0 = _mm_loadu_ps(vz + i);
+        int was = _mm_movemask_ps(_mm_or_ps(_mm_cmpneq_ps(z0, zero), _mm_cmpneq_ps(v0, zero)));
+        __m128 v = _mm_sub_ps(v0, vg);
+        __m128 h = _mm_add_ps(z0, v);
+        __m128 aloft = _mm_cmpnle_ps(h, zero); // !(h <= 0), as the scalar landed test
+        _mm_storeu_ps(z + i, _mm_and_ps(aloft, h));
+        _mm_storeu_ps(vz + i, _mm_and_ps(aloft, v));
+        int mask = _mm_movemask_ps(aloft);
+        for (int k = 0; k < 4; k++) { moved[i + k] = uint8_t((was >> k) & 1); up += (mask >> k) & 1; }
+    }
+    return up + integrateVerticalScalar(z + i, vz + i, moved + i, n - i, g);
+}
+#elif defined(__ARM_NEON)
+size_t integrateVertical(float* z, float* vz, uint8_t* moved, size_t n, float g) {
+    const float32x4_t zero = vdupq_n_f32(0.0f), vg = vdupq_n_f32(g);
+    size_t i = 0, up = 0;
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t z0 = vld1q_f32(z + i), v0 = vld1q_f32(vz + i);
+        uint32x4_t was = vmvnq_u32(vandq_u32(vceqq_f32(z0, zero), vceqq_f32(v0, zero)));
+        float32x4_t v = vsubq_f32(v0, vg);
+        float32x4_t h = vaddq_f32(z0, v);
+        uint32x4_t aloft = vmvnq_u32(vcleq_f32(h, zero)); // !(h <= 0), as the scalar landed test
+        vst1q_f32(z + i, vreinterpretq_f32_u32(vandq_u32(aloft, vreinterpretq_u32_f32(h))));
+        vst1q_f32(vz + i, vreinterpretq_f32_u32(vandq_u32(aloft, vreinterpretq_u32_f32(v))));
+        uint32_t w[4], a[4];
+        vst1q_u32(w, was);
+        vst1q_u32(a, aloft);
+        for (int k = 0; k < 4; k++) { moved[i + k] = uint8_t(w[k] & 1); up += a[k] & 1; }
+    }
+    return up + integrateVerticalScalar(z + i, vz + i, moved + i, n - i, g);
+}
+#else
+size_t integrateVertical(float* z, float* vz, uint8_t* moved, size_t n, float g) {
+    return integrateVerticalScalar(z, vz, moved, n, g);
+}
+#endif
+
+// Runs both over launches, apexes, landings and rest, signed zeros included.
+// False if any output differs.
+bool integrateVerticalMatchesScalar() {
+    const float g = gravityStep(), j = jumpVelocity();
+    const float zs[] = { 0.0f, -0.0f, 1e-7f, g, 0.5f * g, 0.01f, 0.5f, 0.9f, 3.0f };
+    const float vs[] = { 0.0f, -0.0f, j, -j, g, -g, 1e-7f, -1e-7f, 0.5f * j, -2.0f * j };
+    std::vector<float> z1, v1;
+    for (float a : zs) for (float b : vs) { z1.push_back(a); v1.push_back(b); }
+    size_t n = z1.size();
+    std::vector<float> z2(z1), v2(v1);
+    std::vector<uint8_t> m1(n), m2(n);
+    size_t up1 = integrateVerticalScalar(z1.data(), v1.data(), m1.data(), n, g);
+    size_t up2 = integrateVertical(z2.data(), v2.data(), m2.data(), n, g);
+    return up1 == up2 && m1 == m2 && std::memcmp(z1.data(), z2.data(), n * sizeof(float)) == 0 &&
+           std::memcmp(v1.data(), v2.data(), n * sizeof(float)) == 0;
+}
+
+// Batch move validation over SoA buffers: new position, grid cell and illegal
+// mask for n entities in one pass. The scalar loop is the reference the
+// vector paths must match bit for bit (std::round rounds halves away from zero,
+// so the SIMD paths emulate that instead of using round-to-even). Each is
+// instantiated per World so a fixed size folds its bounds into constants.
+template<typename World>
+void validateMovesScalarIn(const World& w, const float* x, const float* y, const float* dx, const float* dy, size_t n,
+                           float* nx, float* ny, int32_t* gx, int32_t* gy, uint8_t* illegal) {
+    for (size_t i = 0; i < n; i++) {
+        nx[i] = x[i] + dx[i];
+        ny[i] = y[i] + dy[i];
+        gx[i] = worldCellX(w, nx[i]);
+        gy[i] = worldCellY(w, ny[i]);
+        illegal[i] = inWorld(w, nx[i], ny[i]) ? 0 : 1;
+    }
+}
+
+#if defined(__AVX2__)
+inline __m256 roundHalfAway8(__m256 v) {
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+    __m256 t = _mm256_round_ps(v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+    __m256 frac = _mm256_andnot_ps(signMask, _mm256_sub_ps(v, t));
+    __m256 one = _mm256_or_ps(_mm256_and_ps(v, signMask), _mm256_set1_ps(1.0f));
+    return _mm256_add_ps(t, _mm256_and_ps(_mm256_cmp_ps(frac, _mm256_set1_ps(0.5f), _CMP_GE_OQ), one));
+}
+
+template<typename World>
+void validateMovesIn(const World& w, const float* x, const float* y, const float* dx, const float* dy, size_t n,
+                     float* nx, float* ny, int32_t* gx, int32_t* gy, uint8_t* illegal) {
+    const __m256 ex = _mm256_set1_ps(w.extentX()), ey = _mm256_set1_ps(w.extentY());
+    const __m256 nex = _mm256_set1_ps(-w.extentX()), ney = _mm256_set1_ps(-w.extentY());
+    const __m256 top = _mm256_set1_ps(float(w.height() - 1));
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 vx = _mm256_add_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(dx + i));
+        __m256 vy = _mm256_add_ps(_mm256_loadu_ps(y + i), _mm256_loadu_ps(dy + i));
+        _mm256_storeu_ps(nx + i, vx);
+        _mm256_storeu_ps(ny + i, vy);
+        _mm256_storeu_si256((__m256i*)(gx + i), _mm256_cvttps_epi32(_mm256_add_ps(roundHalfAway8(vx), ex)));
+        _mm256_storeu_si256((__m256i*)(gy + i), _mm256_cvttps_epi32(_mm256_sub_ps(top, _mm256_add_ps(roundHalfAway8(vy), ey))));
+        __m256 bad = _mm256_or_ps(_mm256_or_ps(_mm256_cmp_ps(vx, nex, _CMP_LT_OQ), _mm256_cmp_ps(vx, ex, _CMP_GT_OQ)),
+                                  _mm256_or_ps(_mm256_cmp_ps(vy, ney, _CMP_LT_OQ), _mm256_cmp_ps(vy, ey, _CMP_GT_OQ)));
+        int mask = _mm256_movemask_ps(bad);
+        for (int k = 0; k < 8; k++) illegal[i + k] = uint8_t((mask >> k) & 1);
+    }
+    validateMovesScalarIn(w, x + i, y + i, dx + i, dy + i, n - i, nx + i, ny + i, gx + i, gy + i, illegal + i);
+}
+#elif defined(__SSE2__)
+// SSE2 is the x86-64 baseline, so a build without -m flags still gets this
+// path; SSE4.1 only adds a native truncate
+inline __m128 truncate4(__m128 v) {
+#if defined(__SSE4_1__)
+    return _mm_round_ps(v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+#else
+    // Round trip through int32; at 2^23 and beyond every float is already
+    // integral (and may not fit), so those lanes keep v
+    __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+    __m128 big = _mm_cmpge_ps(_mm_andnot_ps(_mm_set1_ps(-0.0f), v), _mm_set1_ps(8388608.0f));
+    return _mm_or_ps(_mm_and_ps(big, v), _mm_andnot_ps(big, t));
+#endif
+}
+inline __m128 roundHalfAway4(__m128 v) {
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    __m128 t = truncate4(v);
+    __m128 frac = _mm_andnot_ps(signMask, _mm_sub_ps(v, t));
+    __m128 one = _mm_or_ps(_mm_and_ps(v, signMask), _mm_set1_ps(1.0f));
+    return _mm_add_ps(t, _mm_and_ps(_mm_cmpge_ps(frac, _mm_set1_ps(0.5f)), one));
+}
+
+template<typename World>
+void validateMovesIn(const World& w, const float* x, const float* y, const float* dx, const float* dy, size_t n,
+                     float* nx, float* ny, int32_t* gx, int32_t* gy, uint8_t* illegal) {
+    const __m128 ex = _mm_set1_ps(w.extentX()), ey = _mm_set1_ps(w.extentY());
+    const __m128 nex = _mm_set1_ps(-w.extentX()), ney = _mm_set1_ps(-w.extentY());
+    const __m128 top = _mm_set1_ps(float(w.height() - 1));
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 vx = _mm_add_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(dx + i));
+        __m128 vy = _mm_add_ps(_mm_loadu_ps(y + i), _mm_loadu_ps(dy + i));
+        _mm_storeu_ps(nx + i, vx);
+        _mm_storeu_ps(ny + i, vy);
+        _mm_storeu_si128((__m128i*)(gx + i), _mm_cvttps_epi32(_mm_add_ps(roundHalfAway4(vx), ex)));
+        _mm_storeu_si128((__m128i*)(gy + i), _mm_cvttps_epi32(_mm_sub_ps(top, _mm_add_ps(roundHalfAway4(vy), ey))));
+        __m128 bad = _mm_or_ps(_mm_or_ps(_mm_cmplt_ps(vx, nex), _mm_cmpgt_ps(vx, ex)),
+                               _mm_or_ps(_mm_cmplt_ps(vy, ney), _mm_cmpgt_ps(vy, ey)));
+        int mask = _mm_movemask_ps(bad);
+        for (int k = 0; k < 4; k++) illegal[i + k] = uint8_t((mask >> k) & 1);
+    }
+    validateMovesScalarIn(w, x + i, y + i, dx + i, dy + i, n - i, nx + i, ny + i, gx + i, gy + i, illegal + i);
+}
+#elif defined(__ARM_NEON)
+inline float32x4_t roundHalfAway4(float32x4_t v) { return vrndaq_f32(v); } // native round-half-away
+
+template<typename World>
+void validateMovesIn(const World& w, const float* x, const float* y, const float* dx, const float* dy, size_t n,
+                     float* nx, float* ny, int32_t* gx, int32_t* gy, uint8_t* illegal) {
+    const float32x4_t ex = vdupq_n_f32(w.extentX()), ey = vdupq_n_f32(w.extentY());
+    const float32x4_t nex = vdupq_n_f32(-w.extentX()), ney = vdupq_n_f32(-w.extentY());
+    const float32x4_t top = vdupq_n_f32(float(w.height() - 1));
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t vx = vaddq_f32(vld1q_f32(x + i), vld1q_f32(dx + i));
+        float32x4_t vy = vaddq_f32(vld1q_f32(y + i), vld1q_f32(dy + i));
+        vst1q_f32(nx + i, vx);
+        vst1q_f32(ny + i, vy);
+        vst1q_s32(gx + i, vcvtq_s32_f32(vaddq_f32(roundHalfAway4(vx), ex)));
+        vst1q_s32(gy + i, vcvtq_s32_f32(vsubq_f32(top, vaddq_f32(roundHalfAway4(vy), ey))));
+        uint32x4_t bad = vorrq_u32(vorrq_u32(vcltq_f32(vx, nex), vcgtq_f32(vx, ex)),
+                                   vorrq_u32(vcltq_f32(vy, ney), vcgtq_f32(vy, ey)));
+        uint32_t lanes[4];
+        vst1q_u32(lanes, bad);
+        for (int k = 0; k < 4; k++) illegal[i + k] = uint8_t(lanes[k] & 1);
+    }
+    validateMovesScalarIn(w, x + i, y + i, dx + i, dy + i, n - i, nx + i, ny + i, gx + i, gy + i, illegal + i);
+}
+#else
+template<typename World>
+void validateMovesIn(const World& w, const float* x, const float* y, const float* dx, const float* dy, size_t n,
+                     float* nx, float* ny, int32_t* gx, int32_t* gy, uint8_t* illegal) {
+    validateMovesScalarIn(w, x, y, dx, dy, n, nx, ny, gx, gy, illegal);
+}
+#endif
+
+// Validate against the configured world
+void validateMovesScalar(const float* x, const float* y, const float* dx, const float* dy, size_t n,
+                         float* nx, float* ny, int32_t* gx, int32_t* gy, uint8_t* illegal) {
+    withWorld([&](const auto& w) { validateMovesScalarIn(w, x, y, dx, dy, n, nx, ny, gx, gy, illegal); });
+}
+void validateMoves(const float* x, const float* y, const float* dx, const float* dy, size_t n,
+                   float* nx, float* ny, int32_t* gx, int32_t* gy, uint8_t* illegal) {
+    withWorld([&](const auto& w) { validateMovesIn(w, x, y, dx, dy, n, nx, ny, gx, gy, illegal); });
+}
+
+// Runs both kernels over the inputs rounding is easiest to get wrong: exact
+// and near halves, signed zeros, the world edges, and magnitudes from 2^23 up
+// where every float is already integral. False if any output differs.
+bool validateMovesMatchesScalar() {
+    const float edges[] = { 0.0f, -0.0f, 0.5f, -0.5f, 0.49999997f, -0.49999997f, 0.50000006f, -0.50000006f,
+                            1.5f, -1.5f, 2.5f, -2.5f, 4.5f, -4.5f, 5.0f, -5.0f, 5.5f, -5.5f, 5.0000005f, -5.0000005f,
+                            8388608.0f, -8388608.0f, 8388609.0f, -8388609.0f, 16777216.0f, -16777216.0f, 1e9f, -1e9f };
+    const float steps[] = { 0.0f, -0.0f, 0.5f, -0.5f, 0.25f };
+    std::vector<float> x, y, dx, dy;
+    for (float a : edges)
+        for (float b : edges)
+            for (float d : steps) { x.push_back(a); y.push_back(b); dx.push_back(d); dy.push_back(-d); }
+    size_t n = x.size();
+    std::vector<float> nx1(n), ny1(n), nx2(n), ny2(n);
+    std::vector<int32_t> gx1(n), gy1(n), gx2(n), gy2(n);
+    std::vector<uint8_t> bad1(n), bad2(n);
+    validateMovesScalar(x.data(), y.data(), dx.data(), dy.data(), n, nx1.data(), ny1.data(), gx1.data(), gy1.data(), bad1.data());
+    validateMoves(x.data(), y.data(), dx.data(), dy.data(), n, nx2.data(), ny2.data(), gx2.data(), gy2.data(), bad2.data());
+    // Bitwise, so a -0.0f where the reference has 0.0f counts
+    return std::memcmp(nx1.data(), nx2.data(), n * sizeof(float)) == 0 && std::memcmp(ny1.data(), ny2.data(), n * sizeof(float)) == 0 &&
+           gx1 == gx2 && gy1 == gy2 && bad1 == bad2;
+}
+
+// Validates a batch in which every client appears at most once, so no
+// action depends on another one's result. Gathers positions into SoA scratch,
+// runs validateMoves over all of them, then scatters flags back; gx/gy receive
+// each action's grid cell. Scratch comes from the caller's tick arena.
+void validateBatch(EntityStore& store, TickArena& arena, GameAction* acts, size_t n, uint8_t* legal, int32_t* gx, int32_t* gy) {
+    float* x = arena.alloc<float>(n);
+    float* y = arena.alloc<float>(n);
+    float* dx = arena.alloc<float>(n);
+    float* dy = arena.alloc<float>(n);
+    float* nx = arena.alloc<float>(n);
+    float* ny = arena.alloc<float>(n);
+    uint8_t* illegal = arena.alloc<uint8_t>(n);
+
+    for (size_t i = 0; i < n; i++) {
+        uint32_t idx = store.add(acts[i].clientID);
+        x[i] = store.x[idx];
+        y[i] = store.y[idx];
+        bool move = acts[i].kind == ActionKind::Move;
+        dx[i] = move ? acts[i].deltaX() : 0.0f;
+        dy[i] = move ? acts[i].deltaY() : 0.0f;
+    }
+    validateMoves(x, y, dx, dy, n, nx, ny, gx, gy, illegal);
+    for (size_t i = 0; i < n; i++) {
+        if (illegal[i]) acts[i].flags |= ACTION_ILLEGAL;
+        legal[i] = !illegal[i];
+    }
+}
+
+// Anti-cheat rule engine. Each rule is a plain loop over one wave's actions
+// (at most one per client) gathered into SoA scratch, writing a hit flag per
+// action; the engine ORs the hits into the legality mask and counts them per
+// rule. Windows are RuleLimits::windowTicks long, one second of ticks.
+struct RuleLimits {
+    float maxSpeedPerTick = 4.0f;      // summed move distance in one tick
+    uint16_t maxActionsPerWindow = 40; // received actions, accepted or not
+    uint16_t maxShootsPerWindow = 12;
+    uint32_t jumpCooldownTicks = 2;    // ticks between accepted jumps
+    uint16_t throttleAt = 10;          // rejections in one window that throttle the client
+    uint8_t kickAt = 3;                // throttles that turn into a kick
+    uint32_t windowTicks = DEFAULT_TICK_HZ; // set from the tick rate; also the throttle length
+};
+RuleLimits ruleLimits;
+
+struct RuleBatch {
+    size_t n;
+    uint32_t tick;
+    const uint8_t* isMove;
+    const uint8_t* isJump;
+    const uint8_t* isShoot;
+    const float* dist;      // move length, 0 for other kinds
+    const RuleState* state; // rolled over to this tick's windows
+};
+typedef void (*RuleFn)(const RuleBatch& b, const RuleLimits& lim, uint8_t* hit);
+
+void ruleMaxSpeed(const RuleBatch& b, const RuleLimits& lim, uint8_t* hit) {
+    for (size_t i = 0; i < b.n; i++) hit[i] = uint8_t(b.state[i].moved + b.dist[i] > lim.maxSpeedPerTick);
+}
+void ruleActionRate(const RuleBatch& b, const RuleLimits& lim, uint8_t* hit) {
+    for (size_t i = 0; i < b.n; i++) hit[i] = uint8_t(b.state[i].windowActions >= lim.maxActionsPerWindow);
+}
+void ruleJumpCooldown(const RuleBatch& b, const RuleLimits& lim, uint8_t* hit) {
+    for (size_t i = 0; i < b.n; i++) {
+        uint32_t last = b.state[i].lastJumpTick;
+        hit[i] = uint8_t(b.isJump[i] & (last != 0) & (b.tick + 1 - last < lim.jumpCooldownTicks));
+    }
+}
+void ruleShootCap(const RuleBatch& b, const RuleLimits& lim, uint8_t* hit) {
+    for (size_t i = 0; i < b.n; i++) hit[i] = uint8_t(b.isShoot[i] & (b.state[i].windowShoots >= lim.maxShootsPerWindow));
+}
+
+struct Rule { const char* name; RuleFn eval; };
+const Rule RULES[] = {
+    { "max_speed", ruleMaxSpeed },
+    { "action_rate", ruleActionRate },
+    { "jump_cooldown", ruleJumpCooldown },
+    { "shoot_cap", ruleShootCap },
+};
+const size_t RULE_COUNT = sizeof(RULES) / sizeof(RULES[0]);
+
+struct RuleCounters {
+    uint64_t hits[RULE_COUNT] = {};
+    uint64_t throttles = 0, kicks = 0;
+};
+
+// Runs every rule over a wave that validateBatch has bounds-checked, clearing
+// legal[] and flagging the action for each hit, then advances each client's
+// rule state. Shoots and the rate window count attempts; speed and cooldown
+// only count what was accepted.
+void evaluateRules(EntityStore& store, TickArena& arena, GameAction* acts, size_t n, uint8_t* legal, uint32_t tick, RuleCounters& counters) {
+    const RuleLimits& lim = ruleLimits;
+    uint32_t* idx = arena.alloc<uint32_t>(n);
+    RuleState* state = arena.alloc<RuleState>(n);
+    uint8_t* isMove = arena.alloc<uint8_t>(n);
+    uint8_t* isJump = arena.alloc<uint8_t>(n);
+    uint8_t* isShoot = arena.alloc<uint8_t>(n);
+    float* dist = arena.alloc<float>(n);
+    uint8_t* hit = arena.alloc<uint8_t>(n);
+
+    for (size_t i = 0; i < n; i++) {
+        idx[i] = store.indexOf(acts[i].clientID);
+        RuleState s = store.rules[idx[i]];
+        if (tick - s.windowTick >= lim.windowTicks) { s.windowTick = tick; s.windowActions = s.windowShoots = s.windowPenalties = 0; }
+        if (s.speedTick != tick) { s.speedTick = tick; s.moved = 0.0f; }
+        state[i] = s;
+        isMove[i] = acts[i].kind == ActionKind::Move;
+        isJump[i] = acts[i].kind == ActionKind::Jump;
+        isShoot[i] = acts[i].kind == ActionKind::Shoot;
+        float dx = acts[i].deltaX(), dy = acts[i].deltaY();
+        dist[i] = isMove[i] ? std::sqrt(dx * dx + dy * dy) : 0.0f;
+    }
+    RuleBatch batch = { n, tick, isMove, isJump, isShoot, dist, state };
+    for (size_t r = 0; r < RULE_COUNT; r++) {
+        RULES[r].eval(batch, lim, hit);
+        uint64_t hits = 0;
+        for (size_t i = 0; i < n; i++) { hits += hit[i]; legal[i] &= uint8_t(!hit[i]); }
+        counters.hits[r] += hits;
+    }
+    for (size_t i = 0; i < n; i++) {
+        RuleState& s = state[i];
+        if (!legal[i]) acts[i].flags |= ACTION_ILLEGAL;
+        if (s.windowActions < UINT16_MAX) s.windowActions++;
+        if (isShoot[i] && s.windowShoots < UINT16_MAX) s.windowShoots++;
+        if (legal[i]) {
+            s.moved += dist[i];
+            if (isJump[i]) s.lastJumpTick = tick + 1;
+        }
+        else if (++s.windowPenalties >= lim.throttleAt && s.throttledUntil <= tick) {
+            s.throttledUntil = tick + lim.windowTicks;
+            s.windowPenalties = 0;
+            counters.throttles++;
+            if (++s.strikes >= lim.kickAt && !s.kicked) { s.kicked = 1; counters.kicks++; }
+        }
+        store.rules[idx[i]] = s;
+    }
+}
+
+// Palette index in the low bits, COLOR_DIM on top
+enum Color : uint8_t { COLOR_DEFAULT, COLOR_RED, COLOR_GREEN, COLOR_YELLOW, COLOR_MAGENTA, COLOR_CYAN, COLOR_GRAY };
+const uint8_t COLOR_DIM = 0x80;
+const char* const COLOR_SGR[] = { "", ";31", ";32", ";33", ";35", ";36", ";90" };
+const uint8_t ACTION_COLORS[] = { COLOR_GREEN, COLOR_YELLOW, COLOR_RED };
+
+// Writes the whole buffer to stdout, in one syscall unless the kernel splits it
+void writeAll(const char* data, size_t n) {
+#ifdef _WIN32
+    fwrite(data, 1, n, stdout);
+    fflush(stdout);
+#else
+    while (n > 0) {
+        ssize_t w = ::write(STDOUT_FILENO, data, n);
+        if (w < 0) { if (errno == EINTR) continue; return; }
+        data += w; n -= size_t(w);
+    }
+#endif
+}
+
+struct TermCell {
+    char glyph;
+    uint8_t color;
+    bool operator==(const TermCell& o) const { return glyph == o.glyph && color == o.color; }
+    bool operator!=(const TermCell& o) const { return !(*this == o); }
+};
+
+// Double-buffered terminal grid. Callers fill the back buffer, present() diffs
+// it against what is on screen and emits cursor moves/colour changes only for
+// cells that changed, building the frame in one reused byte buffer.
+class TerminalRenderer {
+    int width, height;
+    std::string title;
+    std::vector<TermCell> front, back;
+    std::vector<std::string> frontLines, backLines; // status lines under the grid
+    std::vector<char> out;
+    bool fullRedraw = true;
+    int curRow = -1, curCol = -1;
+    uint8_t curColor = 0xFF;
+    size_t lastBytes = 0;
+
+    void append(const char* s, size_t n) { out.insert(out.end(), s, s + n); }
+    void append(const char* s) { append(s, std::strlen(s)); }
+    void appendInt(int v) { char buf[16]; int n = std::snprintf(buf, sizeof(buf), "%d", v); append(buf, size_t(n)); }
+    void moveTo(int row, int col) {
+        if (row == curRow && col == curCol) return;
+        if (row == curRow && col == curCol + 1) { out.push_back(' '); curCol++; return; }
+        append("\033["); appendInt(row); out.push_back(';'); appendInt(col); out.push_back('H');
+        curRow = row; curCol = col;
+    }
+    void setColor(uint8_t c) {
+        if (c == curColor) return;
+        append("\033[0");
+        if (c & COLOR_DIM) append(";2");
+        append(COLOR_SGR[c & ~COLOR_DIM]);
+        out.push_back('m');
+        curColor = c;
+    }
+public:
+    TerminalRenderer(int w, int h, size_t statusLines, const std::string& heading)
+        : width(w), height(h), title(heading), front(size_t(w) * h), back(size_t(w) * h),
+          frontLines(statusLines), backLines(statusLines) {
+        out.reserve(size_t(w) * h * 16 + 256);
+    }
+
+    int cols() const { return width; }
+    int rows() const { return height; }
+    void clear() { std::fill(back.begin(), back.end(), TermCell{ '.', COLOR_DEFAULT }); }
+    void set(int idx, char glyph, uint8_t color) { back[idx] = { glyph, color }; }
+    std::string& statusLine(size_t i) { return backLines[i]; }
+    void invalidate() { fullRedraw = true; }
+    size_t lastFrameBytes() const { return lastBytes; }
+
+    // Builds the diff frame into the byte buffer without writing it
+    void build() {
+        out.clear();
+        if (fullRedraw) {
+            append("\033[0m\033[2J\033[H");
+            append(title.c_str()); append("\n");
+            curRow = 2; curCol = 1; curColor = COLOR_DEFAULT;
+        }
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                const TermCell& c = back[size_t(y) * width + x];
+                if (!fullRedraw && c == front[size_t(y) * width + x]) continue;
+                moveTo(2 + y, 1 + 2 * x);
+                setColor(c.color);
+                out.push_back(c.glyph);
+                curCol++;
+            }
+        }
+        for (size_t i = 0; i < backLines.size(); i++) {
+            if (!fullRedraw && backLines[i] == frontLines[i]) continue;
+            moveTo(height + 3 + int(i), 1);
+            setColor(COLOR_DEFAULT);
+            append(backLines[i].c_str(), backLines[i].size());
+            append("\033[K");
+            curRow = -1;
+        }
+        setColor(COLOR_DEFAULT);
+        moveTo(height + 3 + int(backLines.size()), 1); // park the cursor under the map
+        front.swap(back);
+        frontLines.swap(backLines);
+        fullRedraw = false;
+        lastBytes = out.size();
+    }
+    void present() {
+        build();
+        writeAll(out.data(), out.size());
+    }
+};
+
+//Server
+
+// Interest management: each client is sent only entities within aoiRadius,
+// found through spatialIndex, so its cost follows local density rather than
+// player count. The in-range set is encoded against the last snapshot the
+// client acknowledged: remote transports report real acks, in-process ones
+// are assumed to return snapshotAckLag ticks later. In a cluster the ghosts
+// that neighbouring nodes send of their border entities are in range too.
+void replicateInterest(TickArena& arena) {
+    // Scratch for one client at a time, sized for a client that sees everyone
+    size_t maxInRange = serverState.size() + cluster.ghostCount();
+    uint32_t* inRange = arena.alloc<uint32_t>(maxInRange);
+    QuantEntity* cur = arena.alloc<QuantEntity>(maxInRange);
+    size_t packetCap = 32 + maxInRange * 15;
+    uint8_t* packet = arena.alloc<uint8_t>(packetCap);
+    // Every joiner this tick would get the same keyframe; once one world
+    // keyframe overflows a datagram, the rest go straight to their AOI
+    bool keyframeFits = true;
+    for (size_t i = 0; i < serverState.size(); i++) {
+        if (!serverState.alive[i] || serverState.rules[i].kicked) continue; // kicked clients are sent nothing more
+        uint32_t client = serverState.ids[i];
+        if (client >= clientViews.size()) clientViews.resize(size_t(client) + 1);
+        ClientView& view = clientViews[client];
+        view.lastEntities = view.lastBytes = 0;
+
+        // Fills cur with the whole world or just the client's AOI, sorted by ID
+        auto gather = [&](bool world) {
+            size_t n = 0;
+            if (world) {
+                for (size_t e = 0; e < serverState.size(); e++) if (serverState.alive[e]) inRange[n++] = serverState.ids[e];
+            }
+            else spatialIndex.forEachInRange(serverState.x[i], serverState.y[i], aoiRadius,
+                                             [&](uint32_t id, float, float) { inRange[n++] = id; });
+            std::sort(inRange, inRange + n);
+            for (size_t k = 0; k < n; k++) {
+                uint32_t e = serverState.indexOf(inRange[k]);
+                cur[k] = quantizeEntity(inRange[k], serverState.x[e], serverState.y[e], serverState.z[e]);
+            }
+            if (cluster.active()) {
+                size_t local = n;
+                cluster.forEachGhost(serverState.x[i], serverState.y[i], aoiRadius, world, [&](const QuantEntity& g) {
+                    uint32_t e = serverState.indexOf(g.id);
+                    if (e == NO_ENTITY || !serverState.alive[e]) cur[n++] = g; // a ghost that just migrated here is stale
+                });
+                if (n > local) {
+                    std::sort(cur, cur + n, [](const QuantEntity& a, const QuantEntity& b) { return a.id < b.id; });
+                    // Two nodes' border sets can overlap for a tick around a migration
+                    n = size_t(std::unique(cur, cur + n, [](const QuantEntity& a, const QuantEntity& b) { return a.id == b.id; }) - cur);
+                }
+            }
+            return n;
+        };
+        // A client's first snapshot is a keyframe of the whole world, so a late
+        // joiner starts with everything; later ones are deltas over its AOI
+        bool keyframe = view.seq == 0 && keyframeFits;
+        size_t n = gather(keyframe);
+
+        const std::vector<QuantEntity>& last = view.latest();
+        uint32_t inputAck = serverState.lastInput[i];
+        if (view.seq != 0 && view.inputAck == inputAck && last.size() == n &&
+            std::equal(cur, cur + n, last.begin(), [](const QuantEntity& a, const QuantEntity& b) { return a.id == b.id && a.sameState(b); }))
+            continue; // nothing new for this client
+
+        uint32_t seq = view.seq + 1;
+        SnapshotSpan base = { 0, nullptr, 0 };
+        bool haveBase = view.ackedSeq != 0 && seq - view.ackedSeq < SNAPSHOT_RING;
+        if (haveBase) {
+            const std::vector<QuantEntity>& b = view.sent[view.ackedSeq % SNAPSHOT_RING];
+            base = { view.ackedSeq, b.data(), uint32_t(b.size()) };
+        }
+        SnapshotSpan span = { seq, cur, uint32_t(n) };
+        uint32_t changed = 0;
+        size_t bytes = encodeSnapshot(span, haveBase ? &base : nullptr, packet, packetCap, &changed);
+        if (keyframe && bytes + SNAPSHOT_HEADER_BYTES > MAX_DATAGRAM) {
+            // World too big for one datagram: start from the AOI instead
+            keyframe = keyframeFits = false;
+            n = gather(false);
+            span.count = uint32_t(n);
+            bytes = encodeSnapshot(span, nullptr, packet, packetCap, &changed);
+        }
+        if (keyframe) { keyframesSent++; keyframeBytes += bytes; }
+
+        std::vector<QuantEntity>& slot = view.sent[seq % SNAPSHOT_RING];
+        if (slot.capacity() < n) view.reserve(n);
+        slot.assign(cur, cur + n);
+        view.seq = seq;
+        view.inputAck = inputAck;
+        STAT_COUNT(Counter::SnapshotsSent, 1);
+        if (serverTransport->remote()) {
+            if (bytes) serverTransport->sendSnapshot(client, inputAck, packet, bytes);
+            uint32_t ack = serverTransport->ackedSnapshot(client);
+            if (ack > view.ackedSeq && ack <= seq) view.ackedSeq = ack;
+        }
+        else if (seq > snapshotAckLag) view.ackedSeq = seq - snapshotAckLag;
+        view.lastEntities = changed; view.lastBytes = uint32_t(bytes);
+        view.entitiesSent += changed; view.bytesSent += bytes;
+        view.naiveBytes += 8 + n * 16;
+    }
+}
+
+// Publishes this tick's changes to in-process clients and the spatial index:
+// O(dirty entities) instead of O(clients) per tick. Clients reconcile their
+// own prediction against clientReceived; nothing here touches clientPredicted.
+void publishSnapshot(TickArena& arena) {
+    if (serverState.dirty.empty()) return;
+    uint64_t v = snapshotVersion.load(std::memory_order_relaxed) + 1;
+    for (uint32_t idx : serverState.dirty) {
+        serverState.version[idx] = v;
+        uint32_t id = serverState.ids[idx];
+        if (!serverState.alive[idx]) { spatialIndex.remove(id); continue; }
+        spatialIndex.update(id, serverState.x[idx], serverState.y[idx]);
+        clientReceived.publish(id, serverState.x[idx], serverState.y[idx], serverState.z[idx], serverState.lastInput[idx], v);
+    }
+    replicateInterest(arena);
+    serverState.clearDirty();
+    serverState.flushRemovals();
+    snapshotVersion.store(v, std::memory_order_release);
+}
+
+// World sharding: the map is cut into vertical strips, one shard each. A shard
+// owns the entities inside its strip in a private EntityStore and has its own
+// inbox, so shards simulate in parallel without sharing any writes. Between
+// ticks the server thread completes handoffs for entities that crossed a strip
+// boundary and merges each shard's changes into serverState, which stays the
+// complete world view for replication, rendering and reports.
+struct alignas(64) Shard {
+    EntityStore store;
+    std::vector<QueuedAction> inbox;
+    std::vector<HistoryEntry> history; // applied this tick
+    std::vector<EntityRecord> outbox;  // entities leaving the strip at the end of this tick
+    std::vector<uint32_t> seen;        // per-entity wave counter, all zero between ticks
+    TickArena arena{ 16 << 10 };       // this tick's wave and validation scratch
+    uint64_t actions = 0;    // lifetime load, for the imbalance report
+    uint64_t heapAllocs = 0; // made while simulating ticks past the warmup
+    uint64_t launches = 0;   // jumps that left the ground
+    size_t airborne = 0;     // entities in the air, so the shard runs on ticks without actions
+    RuleCounters rules;
+};
+
+std::vector<Shard> shards(1);
+TickArena tickArena(64 << 10); // the tick thread's transient data: routing, replication scratch
+std::vector<uint32_t> shardOwner; // client ID -> shard, NO_ENTITY until its first action is routed
+uint64_t shardHandoffs = 0;
+
+// Strips cut up this node's part of the world, which is all of it outside a cluster
+inline uint32_t shardOf(float x) {
+    int n = int(shards.size());
+    int s = int((x - cluster.stripLeft(cluster.node())) * float(n) / cluster.stripWidth());
+    return uint32_t(s < 0 ? 0 : s >= n ? n - 1 : s);
+}
+
+// Applies one shard's inbox. Actions from the same client are split into
+// successive waves so each wave can be validated as one conflict-free batch
+// while keeping per-client order.
+void simulateShard(uint32_t si) {
+    Shard& sh = shards[si];
+    EntityStore& st = sh.store;
+    uint64_t allocsBefore = heapAllocCount;
+    const std::vector<QueuedAction>& arrived = sh.inbox;
+    size_t total = arrived.size();
+    uint32_t* waveOf = sh.arena.alloc<uint32_t>(total);
+    GameAction* wave = sh.arena.alloc<GameAction>(total);
+    uint8_t* legal = sh.arena.alloc<uint8_t>(total);
+    int32_t* gx = sh.arena.alloc<int32_t>(total);
+    int32_t* gy = sh.arena.alloc<int32_t>(total);
+
+    uint32_t waves = 0;
+    if (sh.seen.size() < st.size()) sh.seen.resize(st.size(), 0);
+    for (size_t i = 0; i < total; i++) {
+        uint32_t idx = st.indexOf(arrived[i].action.clientID);
+        waveOf[i] = sh.seen[idx]++;
+        if (waveOf[i] + 1 > waves) waves = waveOf[i] + 1;
+    }
+    for (size_t i = 0; i < total; i++) sh.seen[st.indexOf(arrived[i].action.clientID)] = 0;
+
+    for (uint32_t w = 0; w < waves; w++) {
+        size_t n = 0;
+        for (size_t i = 0; i < total; i++) if (waveOf[i] == w) wave[n++] = arrived[i].action;
+        {
+            STAGE_TIMER(Stage::Validate);
+            validateBatch(st, sh.arena, wave, n, legal, gx, gy);
+            evaluateRules(st, sh.arena, wave, n, legal, uint32_t(serverTick), sh.rules);
+        }
+        STAT_COUNT(Counter::ActionsValidated, n);
+
+        STAGE_TIMER(Stage::Apply);
+        size_t rejected = 0;
+        for (size_t i = 0; i < n; i++) {
+            const GameAction& action = wave[i];
+            uint32_t idx = st.indexOf(action.clientID);
+            if (legal[i]) {
+                bool grounded = !airborne(st.z[idx], st.vz[idx]);
+                applyLegalAction(st.x[idx], st.y[idx], st.z[idx], st.vz[idx], action);
+                sh.launches += grounded && st.vz[idx] != 0.0f;
+            }
+            else { st.penalty[idx]++; rejected++; }
+            // Rejected inputs are acked too, so the client stops replaying them
+            if (action.seq > st.lastInput[idx]) st.lastInput[idx] = action.seq;
+            st.markDirty(idx);
+
+            // Add to history
+            sh.history.push_back({ action, int16_t(gx[i]), int16_t(gy[i]) });
+        }
+        STAT_COUNT(Counter::ActionsRejected, rejected);
+        (void)rejected;
+    }
+
+    // Gravity for the whole strip, after this tick's jumps have launched
+    {
+        STAGE_TIMER(Stage::Apply);
+        uint8_t* moved = sh.arena.alloc<uint8_t>(st.size());
+        sh.airborne = integrateVertical(st.z.data(), st.vz.data(), moved, st.size(), gravityStep());
+        for (size_t i = 0; i < st.size(); i++) if (moved[i]) st.markDirty(uint32_t(i));
+    }
+
+    // Entities that ended the tick in another strip leave; the server thread
+    // hands them to their new shard, or node, before the next tick
+    for (uint32_t idx : st.dirty) {
+        if (!st.alive[idx] || (shardOf(st.x[idx]) == si && cluster.holds(st.x[idx]))) continue;
+        sh.outbox.push_back(st.record(idx));
+        sh.airborne -= st.z[idx] != 0.0f;
+        st.remove(st.ids[idx]);
+    }
+    // Charged to the shard rather than whichever thread ran it
+    if (serverTick >= ALLOC_WARMUP_TICKS) sh.heapAllocs += heapAllocCount - allocsBefore;
+    heapAllocCount = allocsBefore;
+}
+
+// Runs one tick's shard tasks on a fixed worker pool; the calling thread is
+// worker 0. Shards with work are dealt round-robin, heaviest first, and a
+// worker that empties its own list steals from the others', so a hot shard
+// ties up one core instead of stalling the shards queued behind it. With
+// --pin-workers each shard is dealt to its home worker (shard % workers)
+// instead, so it runs next to its memory unless another worker is idle.
+// With --busy-poll idle workers spin on the generation rather than sleeping.
+class ShardScheduler {
+    struct alignas(64) TaskList {
+        std::vector<uint32_t> tasks;
+        std::atomic<uint32_t> next{ 0 };
+    };
+    std::unique_ptr<TaskList[]> lists;
+    uint32_t workers = 0;
+    std::vector<std::thread> threads;
+    std::mutex m;
+    std::condition_variable cv;
+    std::atomic<uint64_t> generation{ 0 };
+    std::atomic<bool> stopping{ false };
+    std::atomic<uint32_t> finished{ 0 };
+    std::vector<uint32_t> order;
+    void (*task)(uint32_t) = nullptr;
+    bool steal = true;
+
+    void work(uint32_t w) {
+        for (uint32_t k = 0; k < (steal ? workers : 1); k++) {
+            TaskList& l = lists[(w + k) % workers];
+            uint32_t i;
+            while ((i = l.next.fetch_add(1, std::memory_order_relaxed)) < l.tasks.size()) {
+                if (k) steals.fetch_add(1, std::memory_order_relaxed);
+                task(l.tasks[i]);
+            }
+        }
+        finished.fetch_add(1, std::memory_order_acq_rel);
+    }
+    void loop(uint32_t w, uint64_t seen) {
+        if (!placement.workers.empty()) pinThisThread(placement.workers[(w - 1) % placement.workers.size()]);
+        prepareThreadStats({ Stage::Validate, Stage::Apply }); // what simulateShard times
+        for (;;) {
+            if (placement.busyPoll) {
+                uint64_t g;
+                while ((g = generation.load(std::memory_order_acquire)) == seen && !stopping.load(std::memory_order_acquire)) cpuRelax();
+                if (stopping.load(std::memory_order_acquire)) return;
+                seen = g;
+            }
+            else {
+                std::unique_lock<std::mutex> lock(m);
+                cv.wait(lock, [&] { return stopping.load() || generation.load() != seen; });
+                if (stopping.load()) return;
+                seen = generation.load();
+            }
+            work(w);
+        }
+    }
+    // Hands the prepared lists to every worker and returns when all are done
+    void dispatch(void (*fn)(uint32_t)) {
+        task = fn;
+        finished.store(0, std::memory_order_relaxed);
+        { std::lock_guard<std::mutex> lock(m); generation.fetch_add(1, std::memory_order_release); } // workers pick up the lists
+        cv.notify_all();
+        work(0);
+        while (finished.load(std::memory_order_acquire) < workers) std::this_thread::yield();
+    }
+public:
+    std::atomic<uint64_t> steals{ 0 };
+
+    ~ShardScheduler() { stop(); }
+    void start(uint32_t n) {
+        stop();
+        workers = n ? n : 1;
+        lists.reset(new TaskList[workers]);
+        stopping = false;
+        for (uint32_t w = 1; w < workers; w++) threads.emplace_back(&ShardScheduler::loop, this, w, generation.load());
+    }
+    void stop() {
+        { std::lock_guard<std::mutex> lock(m); stopping = true; }
+        cv.notify_all();
+        for (auto& t : threads) t.join();
+        threads.clear();
+    }
+    uint32_t size() const { return workers; }
+
+    // Calls fn(i) once for every i < n with costs[i] > 0 and returns when all are done
+    void run(const size_t* costs, size_t n, void (*fn)(uint32_t)) {
+        if (!lists) start(1);
+        order.clear();
+        for (uint32_t i = 0; i < n; i++) if (costs[i]) order.push_back(i);
+        bool homed = !placement.workers.empty();
+        if (workers == 1 || order.empty() || (order.size() == 1 && !homed)) { for (uint32_t i : order) fn(i); return; }
+        // Ties by index, as stable_sort would, without its temporary buffer
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return costs[a] > costs[b] || (costs[a] == costs[b] && a < b); });
+        for (uint32_t w = 0; w < workers; w++) { lists[w].tasks.clear(); lists[w].next.store(0, std::memory_order_relaxed); }
+        for (size_t k = 0; k < order.size(); k++) lists[(homed ? order[k] : k) % workers].tasks.push_back(order[k]);
+        dispatch(fn);
+    }
+    // Calls fn(w) on every worker w, each on its own thread, without stealing
+    void broadcast(void (*fn)(uint32_t)) {
+        if (!lists) start(1);
+        for (uint32_t w = 0; w < workers; w++) { lists[w].tasks.assign(1, w); lists[w].next.store(0, std::memory_order_relaxed); }
+        steal = false;
+        dispatch(fn);
+        steal = true;
+    }
+};
+ShardScheduler shardScheduler;
+
+// Run on each worker once its thread is pinned: sizes the shards homed there
+// for every entity joined so far and first-touches their stores, inboxes and
+// arenas, so that memory sits on the worker's NUMA node. An inbox gets an even
+// share of what one tick can take in; a hot shard grows past it on the tick thread.
+// Unpinned, the tick thread runs it for every worker before the first tick,
+// so buffers start at their working size rather than growing into steady ticks.
+void prefaultShards(uint32_t w) {
+    uint32_t idLimit = 0;
+    for (uint32_t id : serverState.ids) idLimit = std::max(idLimit, id + 1);
+    size_t inbox = (MAX_PENDING_ACTIONS + ACTION_BATCH) / shards.size() + ACTION_BATCH;
+    for (size_t i = w; i < shards.size(); i += shardScheduler.size()) {
+        Shard& sh = shards[i];
+        sh.store.reserve(2 * serverState.size(), idLimit);
+        sh.store.prefault();
+        sh.seen.resize(std::max(sh.seen.size(), 2 * serverState.size()), 0);
+        sh.inbox.reserve(inbox);
+        sh.history.reserve(inbox);
+        sh.outbox.reserve(serverState.size());
+        EntityStore::touch(sh.inbox);
+        EntityStore::touch(sh.history);
+        sh.arena.prefault();
+    }
+}
+
+TickLogWriter tickLog;      // open when --record is given
+size_t loggedEntities = 0;  // serverState entries already in the log
+
+const uint64_t DEFAULT_CHECKPOINT_EVERY = 600; // ticks, 10 s at the default rate
+CheckpointWriter checkpointWriter; // running when --checkpoint is given
+uint64_t checkpointEvery = 0;
+std::vector<uint8_t> checkpointBuf; // swapped with the writer's, so steady state reuses two buffers
+// Time to load --resume and re-simulate the log tail after it
+double resumeMs = 0;
+uint64_t resumeTick = 0, resumeTailRecords = 0;
+
+// Caller holds stateMutex. Entities never leave serverState in a live run,
+// so the ones added since the last record are the dense tail.
+void recordTick(const GameAction* acts, size_t n) {
+    size_t nJoins = serverState.size() - loggedEntities;
+    uint32_t* joins = tickArena.alloc<uint32_t>(nJoins);
+    for (size_t i = 0; i < nJoins; i++) joins[i] = serverState.ids[loggedEntities + i];
+    loggedEntities = serverState.size();
+    tickLog.write(serverTick, joins, nJoins, acts, n, stateChecksum(serverState));
+}
+
+// Lag-compensated hit detection. A Shoot aims along (dx, dy) and hits the
+// nearest other entity within HIT_RADIUS of the SHOT_RANGE segment, judged
+// where the targets were dz ticks ago: the server stamps dz with the
+// shooter's round trip when the shot arrives (stampRewind), which is how old
+// the world the client aimed at was. Candidates come from spatialIndex
+// around the segment, widened by how far anyone can legally move over the
+// rewind, so a tick of shots costs O(shots x local neighbours).
+const float SHOT_RANGE = 8.0f;
+const float HIT_RADIUS = 0.5f;
+uint64_t shotsFired = 0, shotsHit = 0, shotCandidates = 0, shotRewindTicks = 0;
+
+// Sets a live Shoot's rewind from what the server knows of the shooter's
+// round trip: snapshots sent but not yet acknowledged
+void stampRewind(GameAction& a) {
+    uint32_t rtt = snapshotAckLag;
+    if (a.clientID < clientViews.size() && clientViews[a.clientID].ackedSeq)
+        rtt = clientViews[a.clientID].seq - clientViews[a.clientID].ackedSeq;
+    a.dz = int16_t(std::min<uint32_t>(rtt, POSITION_HISTORY_TICKS - 1));
+}
+
+// Applies this tick's accepted shots to serverState and the owning shards'
+// copies. Caller holds stateMutex; positionHistory has this tick's start.
+void resolveShots(const GameAction* shots, size_t n) {
+    for (size_t s = 0; s < n; s++) {
+        const GameAction& a = shots[s];
+        shotsFired++;
+        uint32_t si = serverState.indexOf(a.clientID);
+        float ax = a.deltaX(), ay = a.deltaY(), len = std::sqrt(ax * ax + ay * ay);
+        if (si == NO_ENTITY || len < 1e-3f) continue;
+        ax /= len; ay /= len;
+        uint32_t rewind = std::min<uint32_t>(uint16_t(a.dz), POSITION_HISTORY_TICKS - 1);
+        uint64_t then = serverTick >= rewind ? serverTick - rewind : 0;
+        shotRewindTicks += serverTick - then;
+        float sx = serverState.x[si], sy = serverState.y[si];
+        // The index holds this tick's starting positions
+        float margin = ruleLimits.maxSpeedPerTick * float(std::max<uint64_t>(serverTick - then, 1));
+        float best = SHOT_RANGE + 1.0f;
+        uint32_t target = NO_ENTITY;
+        spatialIndex.forEachInRange(sx + ax * SHOT_RANGE * 0.5f, sy + ay * SHOT_RANGE * 0.5f, SHOT_RANGE * 0.5f + HIT_RADIUS + margin,
+                                    [&](uint32_t id, float, float) {
+            if (id == a.clientID) return;
+            shotCandidates++;
+            float tx, ty;
+            if (!positionHistory.at(serverState.indexOf(id), then, tx, ty)) return;
+            float rx = tx - sx, ry = ty - sy;
+            float along = rx * ax + ry * ay;
+            if (along < 0.0f || along > SHOT_RANGE) return;
+            float off = rx * ay - ry * ax;
+            if (off * off > HIT_RADIUS * HIT_RADIUS) return;
+            // Ties go to the lower ID, so the index's visiting order can't change the outcome
+            if (along < best || (along == best && id < target)) { best = along; target = id; }
+        });
+        if (target == NO_ENTITY) continue;
+        shotsHit++;
+        serverState.timesHit[serverState.indexOf(target)]++;
+        if (target < shardOwner.size() && shardOwner[target] != NO_ENTITY) {
+            EntityStore& owner = shards[shardOwner[target]].store;
+            uint32_t oi = owner.indexOf(target);
+            if (oi != NO_ENTITY && owner.alive[oi]) owner.timesHit[oi]++;
+        }
+    }
+}
+
+// The shard simulating id. The first time, the strip under its current
+// position takes it over from serverState. Caller holds stateMutex.
+uint32_t ownerShard(uint32_t id) {
+    if (id >= shardOwner.size()) shardOwner.resize(size_t(id) + 1, NO_ENTITY);
+    if (shardOwner[id] != NO_ENTITY) return shardOwner[id];
+    uint32_t g = joinEntity(id);
+    shardOwner[id] = shardOf(serverState.x[g]);
+    // Any shard may come to hold every entity; size them now rather than on a handoff mid-game
+    for (Shard& sh : shards) {
+        if (sh.store.capacity() < serverState.size()) sh.store.reserve(2 * serverState.size(), uint32_t(shardOwner.size()));
+        if (sh.seen.size() < 2 * serverState.size()) sh.seen.resize(2 * serverState.size(), 0);
+    }
+    Shard& sh = shards[shardOwner[id]];
+    sh.store.put(serverState.record(g));
+    sh.airborne += serverState.z[g] != 0.0f;
+    return shardOwner[id];
+}
+
+// Sends an entity that crossed out of this node's strip to the node it
+// entered. It keeps its serverState slot, dead, until it comes back.
+// Caller holds stateMutex.
+void migrateEntity(const EntityRecord& r) {
+    cluster.migrate(r);
+    shardOwner[r.id] = NO_ENTITY;
+    serverState.retire(serverState.indexOf(r.id));
+    if (r.id < clientViews.size()) clientViews[r.id].seq = clientViews[r.id].ackedSeq = 0; // a keyframe if it returns
+}
+
+// Applies one tick worth of arrived actions. Routing and the merge hold
+// stateMutex; the shards themselves run outside it. In a cluster, entities
+// migrated in since the last tick join first, and actions for entities that
+// live on another node are forwarded there rather than simulated.
+void simulateTick(const std::vector<QueuedAction>& arrived) {
+    STAGE_TIMER(Stage::Tick);
+    size_t routed = 0;
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        auto route = [&](const QueuedAction& q) {
+            uint32_t id = q.action.clientID;
+            uint32_t owner = ownerShard(id);
+            // Throttled and kicked clients are turned away before they cost any simulation
+            const RuleState& rs = serverState.rules[serverState.indexOf(id)];
+            if (rs.kicked || rs.throttledUntil > serverTick) { (rs.kicked ? droppedKicked : droppedThrottled)++; return; }
+            shards[owner].inbox.push_back(q);
+            routed++;
+        };
+        auto live = [](uint32_t id) { uint32_t g = serverState.indexOf(id); return g != NO_ENTITY && serverState.alive[g] != 0; };
+        if (cluster.active()) {
+            cluster.beginTick(serverTick);
+            for (const EntityRecord& r : cluster.arrivals()) {
+                if (live(r.id)) continue; // already here; a migration never overwrites
+                serverState.put(r);
+                ownerShard(r.id);
+            }
+            for (size_t i = 0; i < cluster.forwardedCount(); i++) {
+                const QueuedAction& q = cluster.forwarded(i);
+                if (cluster.admit(q, cluster.forwardedHops(i), live(q.action.clientID))) route(q);
+            }
+            cluster.clearArrivals();
+        }
+        for (const QueuedAction& q : arrived)
+            if (!cluster.active() || cluster.admit(q, 0, live(q.action.clientID))) route(q);
+        positionHistory.record(serverState, serverTick);
+    }
+    size_t* costs = tickArena.alloc<size_t>(shards.size());
+    for (size_t i = 0; i < shards.size(); i++) costs[i] = shards[i].inbox.size() + (shards[i].airborne ? 1 : 0);
+    shardScheduler.run(costs, shards.size(), simulateShard);
+
+    std::lock_guard<std::mutex> lock(stateMutex);
+    // Sized by what reached the inboxes: in a cluster that includes actions
+    // forwarded from other nodes and excludes the ones forwarded away
+    GameAction* logged = tickLog.isOpen() ? tickArena.alloc<GameAction>(routed) : nullptr;
+    size_t nLogged = 0;
+    GameAction* shots = tickArena.alloc<GameAction>(routed);
+    size_t nShots = 0;
+    // Handoffs first, so the merge below finds moved entities in their new shard
+    for (Shard& sh : shards) {
+        for (const EntityRecord& r : sh.outbox) {
+            if (!cluster.holds(r.x)) { migrateEntity(r); continue; }
+            uint32_t to = shardOf(r.x);
+            shards[to].store.put(r);
+            shards[to].airborne += r.z != 0.0f;
+            shardOwner[r.id] = to;
+            shardHandoffs++;
+        }
+        sh.outbox.clear();
+    }
+    for (Shard& sh : shards) {
+        for (uint32_t idx : sh.store.dirty)
+            if (sh.store.alive[idx]) serverState.put(sh.store.record(idx));
+        sh.store.flushRemovals();
+        {
+            STAGE_TIMER(Stage::History);
+            for (const HistoryEntry& h : sh.history) actionHistory.push_back(h);
+        }
+        if (logged) for (const HistoryEntry& h : sh.history) logged[nLogged++] = h.action;
+        for (const HistoryEntry& h : sh.history)
+            if (h.action.kind == ActionKind::Shoot && !h.action.illegal()) shots[nShots++] = h.action;
+        sh.history.clear();
+        sh.actions += sh.inbox.size();
+        sh.arena.reset();
+    }
+
+    resolveShots(shots, nShots);
+    {
+        STAGE_TIMER(Stage::Broadcast);
+        publishSnapshot(tickArena);
+        if (cluster.active()) cluster.endTick(serverState, std::max(aoiRadius, 1.0f));
+    }
+    if (logged) recordTick(logged, nLogged);
+
+    // Latency covers only what reached a shard: actions the rule engine turned
+    // away or the cluster forwarded to another node were never applied here
+    int64_t appliedNs = nowNs();
+    for (Shard& sh : shards) {
+        for (const QueuedAction& q : sh.inbox) {
+            applyLatency.record(appliedNs - q.submitNs);
+            if (q.action.clientID > lastCheaterID) honestLatency.record(appliedNs - q.submitNs);
+        }
+        sh.inbox.clear();
+    }
+    actionsApplied += routed;
+}
+
+// Immutable copy of what the renderer needs, published by the simulation
+struct RenderSnapshot {
+    uint64_t tick = 0;
+    std::vector<HistoryEntry> history; // oldest to newest
+    std::vector<uint32_t> ids;       // predicted positions of live clients
+    std::vector<float> x, y;
+    std::vector<std::pair<uint32_t, int32_t>> penalties; // clients with a penalty
+};
+
+TripleBuffer<RenderSnapshot> renderSnapshots;
+std::atomic<bool> renderRequested{ false }; // set by the render thread when it wants a fresh snapshot
+
+// Caller must hold stateMutex. Reuses the slot's capacity, so steady state doesn't allocate.
+void captureRenderSnapshot(RenderSnapshot& snap) {
+    snap.tick = serverTick;
+    snap.history.clear();
+    for (const HistoryEntry& h : actionHistory) snap.history.push_back(h);
+    snap.ids.clear(); snap.x.clear(); snap.y.clear();
+    for (uint32_t id = 0; id < clientPredicted.size(); id++) {
+        float x, y, z;
+        uint32_t ack;
+        uint64_t v;
+        if (!clientPredicted.load(id, x, y, z, ack, v)) continue;
+        snap.ids.push_back(id);
+        snap.x.push_back(x);
+        snap.y.push_back(y);
+    }
+    snap.penalties.clear();
+    for (size_t i = 0; i < serverState.size(); i++)
+        if (serverState.alive[i] && serverState.penalty[i] > 0) snap.penalties.push_back({ serverState.ids[i], serverState.penalty[i] });
+}
+
+// The renderer draws a window of the world at most RENDER_VIEW_COLS x
+// RENDER_VIEW_ROWS cells, so its buffers don't grow with the world
+TerminalRenderer makeRenderView(const std::string& heading) {
+    return TerminalRenderer(std::min(world.width(), RENDER_VIEW_COLS), std::min(world.height(), RENDER_VIEW_ROWS), 2, heading);
+}
+
+// Fills the renderer's back buffer and status lines from snap. A world larger
+// than the view is drawn around the first client.
+void composeFrame(TerminalRenderer& renderer, const RenderSnapshot& snap) {
+    renderer.clear();
+    const int cols = renderer.cols(), rows = renderer.rows();
+    int ox = 0, oy = 0; // world cell at the view's top-left
+    if (!snap.ids.empty() && (cols < world.width() || rows < world.height())) {
+        ox = std::max(0, std::min(world.width() - cols, worldCellX(world, snap.x[0]) - cols / 2));
+        oy = std::max(0, std::min(world.height() - rows, worldCellY(world, snap.y[0]) - rows / 2));
+    }
+
+    size_t historySize = snap.history.size();
+    for (size_t i = 0; i < historySize; i++) {
+        const HistoryEntry& h = snap.history[i];
+        const GameAction& act = h.action;
+        int vx = h.gx - ox, vy = h.gy - oy;
+        if (vx < 0 || vx >= cols || vy < 0 || vy >= rows) continue;
+        int idx = vy * cols + vx;
+
+        // Determine fade level
+        float age = float(historySize - i) / historySize;
+        uint8_t color = act.illegal() ? uint8_t(COLOR_MAGENTA) : ACTION_COLORS[size_t(act.kind)];
+
+        if (age < 0.33f) color = COLOR_GRAY;       // oldest
+        else if (age < 0.66f) color |= COLOR_DIM;  // medium dim
+        // else bright for recent
+
+        renderer.set(idx, act.illegal() ? 'X' : ACTION_GLYPHS[size_t(act.kind)], color);
+    }
+
+    // Highlight current client positions
+    for (size_t i = 0; i < snap.ids.size(); i++) {
+        uint32_t id = snap.ids[i];
+        int vx = worldCellX(world, snap.x[i]) - ox;
+        int vy = worldCellY(world, snap.y[i]) - oy;
+        if (vx < 0 || vx >= cols || vy < 0 || vy >= rows) continue;
+        char glyph = id < 10 ? char('0' + id) : id < 36 ? char('a' + id - 10) : '#';
+        renderer.set(vy * cols + vx, glyph, COLOR_CYAN);
+    }
+
+    // Status lines are rebuilt in place, reusing their capacity from the last frame
+    char buf[64];
+    std::string& lastLine = renderer.statusLine(0);
+    lastLine.clear();
+    if (!snap.history.empty()) {
+        const GameAction& last = snap.history.back().action;
+        std::snprintf(buf, sizeof(buf), "Last: Client %u %s%s", last.clientID, actionName(last.kind), last.illegal() ? " (illegal)" : "");
+        lastLine += buf;
+    }
+    std::string& penaltyLine = renderer.statusLine(1);
+    penaltyLine = "Penalties: ";
+    for (auto& p : snap.penalties) {
+        std::snprintf(buf, sizeof(buf), "Client %u=%d ", p.first, p.second);
+        penaltyLine += buf;
+    }
+}
+
+void renderFrame(TerminalRenderer& renderer, const RenderSnapshot& snap) {
+    composeFrame(renderer, snap);
+    renderer.present();
+}
+
+// Draws at its own frame rate from snapshots the simulation publishes; a slow
+// terminal only delays this thread, never the tick loop
+void renderThread(int intervalMs = RENDER_INTERVAL_MS) {
+    pinThisThread(placement.render);
+    TerminalRenderer renderer = makeRenderView("=== ASCII Game Map (Live) ===");
+    std::cout << "\033[?25l"; // hide cursor
+
+    const auto period = std::chrono::milliseconds(intervalMs);
+    auto nextFrame = std::chrono::steady_clock::now();
+    renderRequested.store(true, std::memory_order_release);
+    while (!done) {
+        if (renderSnapshots.update()) {
+            {
+                STAGE_TIMER(Stage::Render);
+                renderFrame(renderer, renderSnapshots.readSlot());
+            }
+            STAT_COUNT(Counter::RenderFrames, 1);
+            renderRequested.store(true, std::memory_order_release);
+        }
+        nextFrame += period;
+        auto t = std::chrono::steady_clock::now();
+        if (nextFrame < t) nextFrame = t;
+        std::this_thread::sleep_until(nextFrame);
+    }
+
+    std::cout << "\033[?25h"; // show cursor
+}
+
+// Per-client admission between the transport and the tick. Every drained
+// action is charged to its client's token bucket (refilled at rate per second,
+// holding up to burst) and parked in that client's own bounded queue; the tick
+// then takes actions round-robin, one per waiting client per turn, up to its
+// budget. Actions over the bucket are "throttled", actions that find the
+// client's queue full are "dropped", and either way a flood only costs the
+// client sending it.
+const double DEFAULT_CLIENT_RATE_LIMIT = 100.0; // actions per second per client, 0 = unlimited
+const double DEFAULT_CLIENT_BURST = 32.0;
+const size_t INGRESS_CLIENT_QUEUE = 256;        // actions parked per client
+const size_t DEFAULT_INGRESS_BUDGET = 4096;     // actions taken into the tick per drain, all clients together
+
+class FairIngress {
+public:
+    struct Client {
+        uint32_t id = 0;
+        double tokens = 0;
+        int64_t refillNs = 0;
+        std::vector<QueuedAction> ring;
+        uint32_t head = 0, count = 0;
+        bool waiting = false; // in the round-robin order
+        // Written by the server thread, read by the stats exporter
+        std::atomic<uint64_t> admitted{ 0 }, throttled{ 0 }, dropped{ 0 };
+    };
+
+    void configure(double perSec, double burstSize, size_t tickBudget) {
+        rate = perSec;
+        burst = std::max(1.0, burstSize);
+        budget = std::max<size_t>(1, tickBudget);
+    }
+
+    void admit(const QueuedAction* in, size_t n, int64_t now) {
+        for (size_t i = 0; i < n; i++) {
+            Client& c = client(in[i].action.clientID, now);
+            if (rate > 0) {
+                c.tokens = std::min(burst, c.tokens + double(now - c.refillNs) * rate / 1e9);
+                c.refillNs = now;
+                if (c.tokens < 1.0) { c.throttled.fetch_add(1, std::memory_order_relaxed); throttledTotal++; continue; }
+                c.tokens -= 1.0;
+            }
+            if (c.count == c.ring.size() && !grow(c)) { c.dropped.fetch_add(1, std::memory_order_relaxed); droppedTotal++; continue; }
+            c.ring[(c.head + c.count++) % c.ring.size()] = in[i];
+            c.admitted.fetch_add(1, std::memory_order_relaxed);
+            admittedTotal++;
+            parked++;
+            if (!c.waiting) { c.waiting = true; order.push_back(slotOf[c.id]); }
+        }
+    }
+
+    // Appends up to min(budget, max) actions to out, one client at a time
+    size_t take(std::vector<QueuedAction>& out, size_t max) {
+        size_t limit = std::min(budget, max), taken = 0;
+        while (taken < limit && !order.empty()) {
+            again.clear();
+            size_t i = 0;
+            for (; i < order.size() && taken < limit; i++) {
+                Client& c = clients[order[i]];
+                out.push_back(c.ring[c.head]);
+                c.head = uint32_t((c.head + 1) % c.ring.size());
+                c.count--;
+                taken++;
+                if (c.count) again.push_back(order[i]);
+                else c.waiting = false;
+            }
+            // Clients the budget didn't reach go first next time
+            again.insert(again.begin(), order.begin() + i, order.end());
+            order.swap(again);
+        }
+        parked -= taken;
+        return taken;
+    }
+
+    size_t backlog() const { return parked; }
+    uint64_t admittedCount() const { return admittedTotal; }
+    uint64_t throttledCount() const { return throttledTotal; }
+    uint64_t droppedCount() const { return droppedTotal; }
+
+    // Visits every client seen so far; safe from any thread
+    template <typename Fn> void forEachClient(Fn fn) const {
+        std::lock_guard<std::mutex> lock(m);
+        for (const Client& c : clients) fn(c);
+    }
+
+private:
+    Client& client(uint32_t id, int64_t now) {
+        if (id < slotOf.size() && slotOf[id] != NO_ENTITY) return clients[slotOf[id]];
+        // First action from this client; a deque never moves the ones already here
+        std::lock_guard<std::mutex> lock(m);
+        if (id >= slotOf.size()) slotOf.resize(size_t(id) + 1, NO_ENTITY);
+        slotOf[id] = uint32_t(clients.size());
+        clients.emplace_back();
+        Client& c = clients.back();
+        c.id = id;
+        c.tokens = burst;
+        c.refillNs = now;
+        if (order.capacity() < clients.size()) { order.reserve(2 * clients.size()); again.reserve(2 * clients.size()); }
+        return c;
+    }
+
+    // A queue starts small and doubles up to INGRESS_CLIENT_QUEUE, so 100k
+    // quiet clients don't each hold a full one
+    static bool grow(Client& c) {
+        if (c.ring.size() >= INGRESS_CLIENT_QUEUE) return false;
+        std::vector<QueuedAction> bigger(std::min(INGRESS_CLIENT_QUEUE, std::max<size_t>(4, 2 * c.ring.size())));
+        for (uint32_t k = 0; k < c.count; k++) bigger[k] = c.ring[(c.head + k) % c.ring.size()];
+        c.ring.swap(bigger);
+        c.head = 0;
+        return true;
+    }
+
+    double rate = DEFAULT_CLIENT_RATE_LIMIT, burst = DEFAULT_CLIENT_BURST;
+    size_t budget = DEFAULT_INGRESS_BUDGET;
+    std::deque<Client> clients;
+    std::vector<uint32_t> slotOf;       // client ID -> index into clients
+    std::vector<uint32_t> order, again; // waiting clients, next to be served first
+    size_t parked = 0;
+    uint64_t admittedTotal = 0, throttledTotal = 0, droppedTotal = 0;
+    mutable std::mutex m; // guards growth of clients against forEachClient
+};
+FairIngress ingress;
+
+// Fixed-tick authoritative loop. Simulated latency is modelled from each
+// action's submit timestamp: an action becomes visible to the server once
+// latencyMs has passed since the client queued it, so nothing sleeps per action.
+// Between ticks the thread sleeps, or with --busy-poll spins, until the next
+// one is due; tickWakeLate records how far past due it actually started.
+void serverThread(const std::vector<int>& clientIDs, int latencyMs = 100, int tickHz = DEFAULT_TICK_HZ) {
+    pinThisThread(placement.server);
+    prepareThreadStats({ Stage::Drain, Stage::Validate, Stage::Apply, Stage::History, Stage::Broadcast, Stage::Tick });
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        // In a cluster a client spawning on another node's strip joins there, with its first action
+        for (int id : clientIDs) if (cluster.spawnsHere(uint32_t(id))) joinEntity(uint32_t(id));
+    }
+    if (!placement.workers.empty()) shardScheduler.broadcast(prefaultShards);
+    else for (uint32_t w = 0; w < shardScheduler.size(); w++) prefaultShards(w);
+
+    const auto tickPeriod = std::chrono::nanoseconds(1000000000LL / tickHz);
+    const int64_t latencyNs = int64_t(latencyMs) * 1000000;
+    snapshotAckLag = uint32_t((2 * latencyNs + tickPeriod.count() - 1) / tickPeriod.count());
+    // Actions are held by value in buffers sized up front for the worst case,
+    // so queueing one never allocates
+    std::vector<QueuedAction> batch(ACTION_BATCH), pending, arrived;
+    pending.reserve(MAX_PENDING_ACTIONS + ACTION_BATCH);
+    arrived.reserve(MAX_PENDING_ACTIONS + ACTION_BATCH);
+    auto nextTick = std::chrono::steady_clock::now();
+    const int64_t startNs = nowNs();
+    int64_t nextSampleNs = startNs;
+
+    while (!done) {
+        uint64_t allocsBefore = heapAllocCount;
+        // Drain everything queued since the last tick into the per-client
+        // queues, then take this tick's share from them round-robin
+        {
+            STAGE_TIMER(Stage::Drain);
+            size_t n, received = 0;
+            int64_t drainNs = nowNs();
+            while (received < MAX_PENDING_ACTIONS && (n = serverTransport->receive(batch.data(), batch.size())) > 0) {
+                ingress.admit(batch.data(), n, drainNs);
+                received += n;
+            }
+            size_t taken = pending.size() < MAX_PENDING_ACTIONS ? ingress.take(pending, MAX_PENDING_ACTIONS - pending.size()) : 0;
+            STAT_COUNT(Counter::ActionsDrained, taken);
+            (void)taken;
+        }
+
+        // Split off the actions whose simulated latency has elapsed
+        int64_t now = nowNs();
+        size_t keep = 0;
+        for (auto& p : pending) {
+            if (p.submitNs + latencyNs <= now) {
+                arrived.push_back(p);
+                if (p.action.kind == ActionKind::Shoot) stampRewind(arrived.back().action);
+            }
+            else pending[keep++] = p;
+        }
+        pending.resize(keep);
+
+        simulateTick(arrived);
+        serverTransport->flush();
+        arrived.clear();
+        tickArena.reset();
+        if (serverTick >= ALLOC_WARMUP_TICKS) {
+            uint64_t allocs = heapAllocCount - allocsBefore;
+            tickHeapAllocs += allocs;
+            if (allocs) ticksWithHeapAllocs++;
+            steadyTicks++;
+        }
+        if (checkpointEvery && (serverTick + 1) % checkpointEvery == 0) {
+            {
+                std::lock_guard<std::mutex> lock(stateMutex);
+                encodeCheckpoint(serverState, positionHistory, serverTick, checkpointBuf);
+            }
+            checkpointWriter.submit(checkpointBuf);
+        }
+        serverTick++;
+
+        if (now >= nextSampleNs) {
+            queueDepthSamples.push_back({ double(now - startNs) / 1e6, serverTransport->backlog() + ingress.backlog() + pending.size() });
+            nextSampleNs += int64_t(DEPTH_SAMPLE_MS) * 1000000;
+        }
+
+        if (renderRequested.exchange(false, std::memory_order_acq_rel)) {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            captureRenderSnapshot(renderSnapshots.writeSlot());
+            renderSnapshots.publish();
+        }
+
+        nextTick += tickPeriod;
+        auto t = std::chrono::steady_clock::now();
+        if (nextTick < t) nextTick = t; // overran, don't try to catch up
+        if (placement.busyPoll) while (std::chrono::steady_clock::now() < nextTick) cpuRelax();
+        else std::this_thread::sleep_until(nextTick);
+        tickWakeLate.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - nextTick).count());
+    }
+}
+
+//Client
+const size_t INPUT_RING = 128;       // unacknowledged inputs a client thread keeps for replay (power of two)
+const size_t POOLED_INPUT_RING = 16; // the same for pooled clients, which are kept small to fit 100k in memory
+
+// Fixed-capacity FIFO of sent-but-unacknowledged inputs, oldest first. When
+// the server falls further behind than N inputs the oldest is overwritten;
+// the next authoritative update then corrects the prediction.
+template <size_t N>
+class InputRing {
+    static_assert((N & (N - 1)) == 0, "InputRing capacity must be a power of two");
+    GameAction items[N];
+    size_t head = 0, count = 0;
+public:
+    size_t size() const { return count; }
+    const GameAction& operator[](size_t i) const { return items[(head + i) & (N - 1)]; }
+    // Returns false when an unacknowledged input had to be overwritten
+    bool push(const GameAction& a) {
+        bool overwrote = count == N;
+        if (overwrote) { head = (head + 1) & (N - 1); count--; }
+        items[(head + count) & (N - 1)] = a;
+        count++;
+        return !overwrote;
+    }
+    // Drops every input the server has applied
+    void ack(uint32_t seq) {
+        while (count && items[head].seq <= seq) { head = (head + 1) & (N - 1); count--; }
+    }
+};
+
+// Client prediction counters, summed over all client threads
+std::atomic<uint64_t> predictionReconciles{ 0 }; // authoritative updates replayed onto
+std::atomic<uint64_t> predictionCorrections{ 0 }; // ...that moved the predicted position
+std::atomic<uint64_t> verticalCorrections{ 0 };   // ...that put a predicted jump back on the ground
+std::atomic<uint64_t> inputRingOverflows{ 0 };
+const float PREDICTION_EPSILON = 1e-3f; // above the wire quantization step of the default world
+
+bool InProcessClientTransport::poll(float& x, float& y, float& z, uint32_t& inputAck) {
+    return clientReceived.poll(clientID, seenVersion, x, y, z, inputAck);
+}
+
+// What a simulated client sends. Mixed picks Move, Jump and Shoot evenly;
+// a walker only moves, a shooter mostly shoots; a cheater sends ten times
+// as fast, with moves up to three units per axis
+enum class Behaviour : uint8_t { Mixed, Walker, Shooter, Cheater, Count };
+const char* const BEHAVIOUR_NAMES[] = { "mixed", "walker", "shooter", "cheater" };
+
+// Relative weights of each behaviour across the simulated clients (--mix)
+struct BehaviourMix {
+    uint32_t weight[size_t(Behaviour::Count)] = { 1, 0, 0, 0 };
+
+    // Spread over IDs by a hash rather than in runs, so any contiguous block
+    // of clients, or any pool thread's share, sees roughly the whole mix
+    Behaviour pick(uint32_t clientID) const {
+        uint32_t total = 0;
+        for (uint32_t w : weight) total += w;
+        uint32_t r = (clientID * 2654435761u >> 8) % (total ? total : 1);
+        for (size_t b = 0; b < size_t(Behaviour::Count); b++) {
+            if (r < weight[b]) return Behaviour(b);
+            r -= weight[b];
+        }
+        return Behaviour::Mixed;
+    }
+};
+
+// One simulated client between actions. step() sends the next action,
+// predicts it locally and, when authoritative state has arrived, drops the
+// acknowledged inputs and replays the rest on top of it, so the client only
+// moves off its prediction when the server disagreed. clientThread drives one
+// of these with sleep_until; a ClientPool drives thousands from timer wheels.
+// Jumps are predicted by stepping stepVertical once per tick of wall time.
+// The server applies a jump one latency later, so its arc trails ours; the
+// snapshots' z only overrides the prediction when the server has the client
+// on the ground with no jump of ours still unacknowledged, i.e. it refused one.
+template <size_t RING, typename Rng>
+struct SimClient {
+    uint32_t id;
+    Behaviour behaviour;
+    std::unique_ptr<ClientTransport> transport;
+    Rng rng;
+    InputRing<RING> inputs;
+    float epsilon;
+    float px = 0.0f, py = 0.0f, pz = 0.0f, pvz = 0.0f; // predicted state
+    uint32_t nextSeq = 1;
+    int64_t intervalNs; // between actions
+    int64_t tickNs, verticalNs; // one tick of vertical prediction, and the time stepped up to
+
+    // rateSpread > 0 gives each client its own rate, uniform in actionsPerSec * [1 - spread, 1 + spread]
+    SimClient(uint32_t clientID, double actionsPerSec, double rateSpread, Behaviour b)
+        : id(clientID), behaviour(b), transport(makeClientTransport(clientID)), rng(makeClientRng<Rng>(clientID)),
+          epsilon(std::max(PREDICTION_EPSILON, quantExtent() / QUANT_MAX)), // remote state is quantized
+          tickNs(std::max<int64_t>(1, int64_t(double(tickSeconds) * 1e9))), verticalNs(nowNs()) {
+        spawnPoint(id, px, py);
+        publishPrediction();
+        double rate = actionsPerSec;
+        if (rateSpread > 0) rate *= 1.0 + rateSpread * double(getRandomFloat(rng, -1.0f, 1.0f));
+        if (behaviour == Behaviour::Cheater) rate *= 10.0;
+        intervalNs = int64_t(1e9 / std::max(rate, 1e-3));
+    }
+
+    GameAction nextAction() {
+        GameAction a;
+        a.clientID = id;
+        a.seq = nextSeq++;
+        switch (behaviour) {
+        case Behaviour::Walker: a.kind = ActionKind::Move; break;
+        case Behaviour::Shooter: a.kind = getRandomFloat(rng, 0.0f, 1.0f) < 0.7f ? ActionKind::Shoot : ActionKind::Move; break;
+        default: a.kind = ActionKind(int(getRandomFloat(rng, 0.0f, 3.0f)) % 3); break;
+        }
+        // A Shoot's (dx, dy) is its aim; the server fills in its dz
+        const float maxMove = a.kind == ActionKind::Shoot ? 1.0f : behaviour == Behaviour::Cheater ? 3.0f : 1.0f;
+        // A Jump carries no deltas: the server launches every jump at JUMP_SPEED
+        if (a.kind != ActionKind::Jump) { a.dx = packDelta(getRandomFloat(rng, -maxMove, maxMove)); a.dy = packDelta(getRandomFloat(rng, -maxMove, maxMove)); }
+        return a;
+    }
+
+    // Runs the vertical prediction over the ticks that have passed since the last call
+    void advanceVertical(int64_t now) {
+        int64_t ticks = (now - verticalNs) / tickNs;
+        verticalNs += ticks * tickNs;
+        for (; ticks > 0 && airborne(pz, pvz); ticks--) stepVertical(pz, pvz, gravityStep());
+    }
+
+    void step() {
+        advanceVertical(nowNs());
+        GameAction a = nextAction();
+        if (!inputs.push(a)) inputRingOverflows.fetch_add(1, std::memory_order_relaxed);
+        predictAction(px, py, pz, pvz, a);
+        transport->send(a, nowNs());
+        transport->flush();
+        STAT_COUNT(Counter::ClientInputs, 1);
+
+        float sx, sy, sz;
+        uint32_t ack;
+        if (transport->poll(sx, sy, sz, ack)) {
+            // A server resumed from a checkpoint remembers inputs from before
+            // this client started; continue numbering after them
+            if (ack >= nextSeq) nextSeq = ack + 1;
+            inputs.ack(ack);
+            float ox = px, oy = py;
+            px = sx; py = sy;
+            // Replaying only moves us in x and y; the unacked jumps are already in our arc
+            float rz = pz, rvz = pvz;
+            bool jumpPending = false;
+            for (size_t i = 0; i < inputs.size(); i++) {
+                predictAction(px, py, rz, rvz, inputs[i]);
+                jumpPending |= inputs[i].kind == ActionKind::Jump;
+            }
+            predictionReconciles.fetch_add(1, std::memory_order_relaxed);
+            bool landed = sz == 0.0f && !jumpPending && airborne(pz, pvz);
+            if (landed) { pz = pvz = 0.0f; verticalCorrections.fetch_add(1, std::memory_order_relaxed); }
+            if (landed || std::fabs(px - ox) > epsilon || std::fabs(py - oy) > epsilon)
+                predictionCorrections.fetch_add(1, std::memory_order_relaxed);
+        }
+        publishPrediction();
+    }
+    // Shows the renderer where we are
+    void publishPrediction() { clientPredicted.publish(id, px, py, pz, 0, nextSeq); }
+};
+
+void clientThread(int id, double actionsPerSec, double rateSpread, Behaviour behaviour) {
+    SimClient<INPUT_RING, std::mt19937> client(uint32_t(id), actionsPerSec, rateSpread, behaviour);
+    const auto interval = std::chrono::nanoseconds(client.intervalNs);
+    auto next = std::chrono::steady_clock::now();
+    while (!done) {
+        client.step();
+        next += interval;
+        std::this_thread::sleep_until(next);
+    }
+}
+
+// Load generator: clients as state machines on a few threads instead of a
+// thread each. Every pool thread owns a share of the clients and a hashed
+// timer wheel of WHEEL_SLOTS slots, WHEEL_SLOT_NS apart; a client sits in the
+// slot its next action falls in (going round again when that is more than a
+// turn away), and the thread sleeps until the next slot and steps whatever
+// is due there, so a pooled client sends at most one action per slot. A
+// thread that falls behind runs slots back to back and reports how late it got.
+// A step never takes stateMutex: snapshots and predictions go through
+// clientReceived and clientPredicted, so the pool doesn't queue behind the tick.
+const size_t WHEEL_SLOTS = 1024;
+const int64_t WHEEL_SLOT_NS = 1000000;
+
+using PooledClient = SimClient<POOLED_INPUT_RING, std::minstd_rand>;
+
+class ClientPool {
+    struct Worker {
+        std::thread thread;
+        std::atomic<uint64_t> steps{ 0 };
+        std::atomic<int64_t> maxLagNs{ 0 };
+        LatencyHistogram lag; // how late each step ran; the thread's own until join()
+    };
+    std::deque<Worker> workers;
+
+    static void run(Worker& w, std::vector<uint32_t> ids, double actionsPerSec, double rateSpread, BehaviourMix mix,
+                    uint32_t lastCheater, int64_t startNs) {
+        std::vector<PooledClient> clients;
+        clients.reserve(ids.size());
+        for (uint32_t id : ids) clients.emplace_back(id, actionsPerSec, rateSpread, id <= lastCheater ? Behaviour::Cheater : mix.pick(id));
+
+        // Slot lists are threaded through link[], NO_ENTITY-terminated
+        std::vector<uint32_t> slotHead(WHEEL_SLOTS, NO_ENTITY), link(clients.size(), NO_ENTITY);
+        std::vector<int64_t> due(clients.size());
+        auto insert = [&](uint32_t c, int64_t slotNs) {
+            size_t s = size_t(std::max(due[c] / WHEEL_SLOT_NS, slotNs / WHEEL_SLOT_NS + 1) % int64_t(WHEEL_SLOTS));
+            link[c] = slotHead[s];
+            slotHead[s] = c;
+        };
+        // Spread first actions over one interval so the clients don't fire in lockstep
+        std::minstd_rand phase(uint32_t(ids.empty() ? 1 : ids[0]));
+        int64_t slotNs = startNs - startNs % WHEEL_SLOT_NS;
+        for (uint32_t c = 0; c < clients.size(); c++) {
+            due[c] = startNs + int64_t(double(clients[c].intervalNs) * std::uniform_real_distribution<double>(0, 1)(phase));
+            insert(c, slotNs);
+        }
+
+        auto next = std::chrono::steady_clock::now();
+        while (!done) {
+            slotNs += WHEEL_SLOT_NS;
+            next += std::chrono::nanoseconds(WHEEL_SLOT_NS);
+            std::this_thread::sleep_until(next);
+            int64_t now = nowNs(), slotEnd = slotNs + WHEEL_SLOT_NS;
+            size_t s = size_t(slotNs / WHEEL_SLOT_NS % int64_t(WHEEL_SLOTS));
+            uint32_t c = slotHead[s];
+            slotHead[s] = NO_ENTITY;
+            uint64_t stepped = 0;
+            while (c != NO_ENTITY) {
+                uint32_t after = link[c];
+                if (due[c] < slotEnd) {
+                    if (now - due[c] > w.maxLagNs.load(std::memory_order_relaxed)) w.maxLagNs.store(now - due[c], std::memory_order_relaxed);
+                    w.lag.record(now - due[c]);
+                    clients[c].step();
+                    due[c] += clients[c].intervalNs;
+                    stepped++;
+                }
+                insert(c, slotNs); // not due yet: a turn or more away
+                c = after;
+            }
+            w.steps.fetch_add(stepped, std::memory_order_relaxed);
+        }
+    }
+
+public:
+    void start(const std::vector<int>& ids, size_t threads, double actionsPerSec, double rateSpread, const BehaviourMix& mix, uint32_t lastCheater) {
+        threads = std::max<size_t>(1, std::min(threads, ids.size()));
+        int64_t startNs = nowNs();
+        for (size_t t = 0; t < threads; t++) {
+            std::vector<uint32_t> share;
+            for (size_t i = t; i < ids.size(); i += threads) share.push_back(uint32_t(ids[i]));
+            workers.emplace_back();
+            Worker& w = workers.back();
+            w.thread = std::thread(run, std::ref(w), std::move(share), actionsPerSec, rateSpread, mix, lastCheater, startNs);
+        }
+    }
+    void join() {
+        for (Worker& w : workers) if (w.thread.joinable()) w.thread.join();
+    }
+    size_t threads() const { return workers.size(); }
+    uint64_t steps() const {
+        uint64_t n = 0;
+        for (const Worker& w : workers) n += w.steps.load(std::memory_order_relaxed);
+        return n;
+    }
+    int64_t maxLagNs() const {
+        int64_t lag = 0;
+        for (const Worker& w : workers) lag = std::max(lag, w.maxLagNs.load(std::memory_order_relaxed));
+        return lag;
+    }
+    // Step lateness across all threads; only after join()
+    LatencyHistogram lag() const {
+        LatencyHistogram h;
+        for (const Worker& w : workers) h.merge(w.lag);
+        return h;
+    }
+};
+ClientPool clientPool;
+
+struct SimConfig {
+    int clients = 2;
+    int cheaters = 0;          // the first N clients break the anti-cheat rules
+    int clientPool = 0;        // run clients as state machines on this many threads, 0 = a thread each
+    double rateSpread = 0.0;   // per-client rate drawn from actionRate * [1 - spread, 1 + spread]
+    BehaviourMix mix;          // behaviours of the clients past the cheaters
+    bool scatterSpawns = false; // new entities start spread over the world rather than at the origin
+    double actionRate = 20.0; // actions per second per client
+    int tickHz = DEFAULT_TICK_HZ;
+    int latencyMs = 50;
+    double durationSec = 15.0;
+    bool render = true;
+    bool bench = false;        // headless run that prints a machine-readable report
+    bool benchWire = false;    // snapshot encoding benchmark only, --clients is the entity count
+    bool benchMicro = false;   // core primitives against the implementations they replaced
+    bool csv = false;          // report format, JSON otherwise
+    size_t historyCapacity = HISTORY_LIMIT;
+    size_t queueCapacity = ACTION_QUEUE_CAPACITY;
+    FullPolicy queuePolicy = FullPolicy::Block;
+    float aoiRadius = DEFAULT_AOI_RADIUS;
+    int worldCols = DEFAULT_WORLD_CELLS, worldRows = DEFAULT_WORLD_CELLS;
+    int shards = 1;            // world strips simulated in parallel
+    int workers = 0;           // shard worker threads, 0 = min(shards, hardware threads)
+    int listenPort = 0;        // serve over UDP; local clients connect through the socket too
+    std::string connectHost;   // client-only process talking to a remote server
+    int connectPort = 0;
+    int clientIdBase = 0;      // offset so several client processes don't share IDs
+    std::vector<std::string> clusterHosts; // every node of a cluster, in strip order
+    std::vector<int> clusterPorts;
+    int node = 0;              // this process's index in the cluster
+    uint32_t seed = 0;         // client RNG seed, 0 = nondeterministic
+    std::string recordPath;    // tick log written during the run
+    std::string replayPath;    // replay this tick log instead of running clients
+    std::string logStatsPath;  // summarize this tick log in parallel instead of running
+    uint64_t fromTick = 0, toTick = UINT64_MAX; // inclusive tick range for --replay / --log-stats
+    std::string checkpointPath; // checkpoint written every checkpointEvery ticks
+    uint64_t checkpointEvery = DEFAULT_CHECKPOINT_EVERY;
+    std::string resumePath;     // start from this checkpoint
+    std::string resumeLogPath;  // ...and re-simulate this log's records after it
+    std::string statsPath;      // instrumentation exported here in Prometheus text format
+    int statsIntervalMs = 1000;
+    double clientRateLimit = DEFAULT_CLIENT_RATE_LIMIT; // token bucket per client, 0 = unlimited
+    double clientBurst = DEFAULT_CLIENT_BURST;
+    size_t ingressBudget = DEFAULT_INGRESS_BUDGET;
+    ThreadPlacement placement; // CPU pinning and busy-poll
+};
+
+void printUsage(const char* argv0) {
+    std::fprintf(stderr,
+        "usage: %s [options]\n"
+        "  --clients N         simulated clients (default 2)\n"
+        "  --rate R            actions per second per client (default 20)\n"
+        "  --cheaters N        the first N clients send 10x as fast with oversized moves\n"
+        "  --client-pool T     run clients on T threads with timer wheels (load generator, 100k+ clients; client_pool_lag_* says whether it kept up)\n"
+        "  --rate-spread F     each client's rate uniform in rate * [1-F, 1+F] (default 0)\n"
+        "  --mix SPEC          behaviour weights, e.g. mixed=70,walker=20,shooter=10,cheater=0\n"
+        "  --spawn S           origin | scatter: where new entities start (default origin)\n"
+        "  --tick-hz H         server tick rate (default %d)\n"
+        "  --latency-ms L      simulated one-way latency (default 50)\n"
+        "  --duration S        run time in seconds (default 15)\n"
+        "  --render / --no-render\n"
+        "  --history N         action history capacity (default %d)\n"
+        "  --queue-capacity N  action queue slots (default %zu)\n"
+        "  --queue-policy P    block | drop-oldest | reject\n"
+        "  --client-rate-limit R  token bucket per client, actions/s (default 100, 0 = off)\n"
+        "  --client-burst B    actions a client may send at once (default 32)\n"
+        "  --ingress-budget N  actions taken into a tick round-robin across clients (default 4096)\n"
+        "  --aoi-radius R      per-client replication radius (default %g)\n"
+        "  --world W[xH]       world size in cells, odd, up to %d (default %d)\n"
+        "  --shards N          world strips simulated in parallel (default 1)\n"
+        "  --workers N         shard worker threads (default min(shards, cores))\n"
+        "  --pin-server CPU    pin the tick thread, which is also shard worker 0 (Linux)\n"
+        "  --pin-workers LIST  pin shard workers 1.. round-robin over LIST, e.g. 2-7,10; shards get home workers\n"
+        "  --pin-render CPU    pin the render thread\n"
+        "  --pin-io CPU        pin the checkpoint writer and stats exporter\n"
+        "  --busy-poll         spin between ticks, and idle shard workers spin, instead of sleeping\n"
+        "  --listen PORT       server receives actions over UDP (Linux)\n"
+        "  --connect HOST:PORT run clients only, against a remote UDP server\n"
+        "  --cluster H:P,H:P.. server nodes, one world strip each, left to right; listens on its own entry\n"
+        "  --node I            this process's index in --cluster (default 0)\n"
+        "  --client-id-base N  first client ID is N+1 (default 0)\n"
+        "  --seed N            seed client RNGs (default: random)\n"
+        "  --record FILE       log every applied action and a state checksum per tick\n"
+        "  --replay FILE       re-simulate a recorded log headless and verify checksums\n"
+        "  --log-stats FILE    scan a recorded log with --workers threads and summarize it\n"
+        "  --from T / --to T   tick range for --replay and --log-stats (inclusive)\n"
+        "  --checkpoint FILE   write the world state to FILE periodically\n"
+        "  --checkpoint-every N  ticks between checkpoints (default %llu)\n"
+        "  --resume FILE       start from a checkpoint (with --replay: verify the log after it)\n"
+        "  --resume-log FILE   re-simulate this log's ticks after the checkpoint before going live\n"
+        "  --stats-file FILE   export stage timings and counters (Prometheus text format)\n"
+        "  --stats-interval-ms N  stats export period (default 1000)\n"
+        "  --bench             headless benchmark, report printed at exit\n"
+        "  --bench-wire        snapshot wire format size/throughput vs naive floats\n"
+        "  --bench-micro       queue, validation, render, history and state lookup microbenchmarks\n"
+        "  --format F          json | csv (benchmark report)\n",
+        argv0, DEFAULT_TICK_HZ, HISTORY_LIMIT, ACTION_QUEUE_CAPACITY, double(DEFAULT_AOI_RADIUS), MAX_WORLD_CELLS, DEFAULT_WORLD_CELLS,
+        (unsigned long long)DEFAULT_CHECKPOINT_EVERY);
+}
+
+// Returns false on a malformed command line
+bool parseArgs(int argc, char** argv, SimConfig& cfg) {
+    bool renderSet = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&](const char*& out) { if (i + 1 >= argc) return false; out = argv[++i]; return true; };
+        const char* v = nullptr;
+        if (arg == "--render") { cfg.render = true; renderSet = true; }
+        else if (arg == "--no-render") { cfg.render = false; renderSet = true; }
+        else if (arg == "--bench") cfg.bench = true;
+        else if (arg == "--bench-wire") cfg.benchWire = true;
+        else if (arg == "--bench-micro") cfg.benchMicro = true;
+        else if (arg == "--clients" && value(v)) cfg.clients = std::atoi(v);
+        else if (arg == "--rate" && value(v)) cfg.actionRate = std::atof(v);
+        else if (arg == "--cheaters" && value(v)) cfg.cheaters = std::atoi(v);
+        else if (arg == "--client-pool" && value(v)) cfg.clientPool = std::atoi(v);
+        else if (arg == "--spawn" && value(v)) {
+            std::string m = v;
+            if (m == "scatter") cfg.scatterSpawns = true;
+            else if (m == "origin") cfg.scatterSpawns = false;
+            else return false;
+        }
+        else if (arg == "--rate-spread" && value(v)) cfg.rateSpread = std::min(1.0, std::max(0.0, std::atof(v)));
+        else if (arg == "--mix" && value(v)) {
+            cfg.mix = BehaviourMix();
+            cfg.mix.weight[0] = 0;
+            std::string spec = v;
+            for (size_t pos = 0; pos < spec.size();) {
+                size_t end = spec.find(',', pos), eq = spec.find('=', pos);
+                if (end == std::string::npos) end = spec.size();
+                if (eq == std::string::npos || eq > end) return false;
+                std::string name = spec.substr(pos, eq - pos);
+                size_t b = 0;
+                while (b < size_t(Behaviour::Count) && name != BEHAVIOUR_NAMES[b]) b++;
+                if (b == size_t(Behaviour::Count)) return false;
+                cfg.mix.weight[b] = uint32_t(std::atoi(spec.c_str() + eq + 1));
+                pos = end + 1;
+            }
+        }
+        else if (arg == "--tick-hz" && value(v)) cfg.tickHz = std::atoi(v);
+        else if (arg == "--latency-ms" && value(v)) cfg.latencyMs = std::atoi(v);
+        else if (arg == "--duration" && value(v)) cfg.durationSec = std::atof(v);
+        else if (arg == "--history" && value(v)) cfg.historyCapacity = size_t(std::atoll(v));
+        else if (arg == "--queue-capacity" && value(v)) cfg.queueCapacity = size_t(std::atoll(v));
+        else if (arg == "--client-rate-limit" && value(v)) cfg.clientRateLimit = std::atof(v);
+        else if (arg == "--client-burst" && value(v)) cfg.clientBurst = std::atof(v);
+        else if (arg == "--ingress-budget" && value(v)) cfg.ingressBudget = size_t(std::atoll(v));
+        else if (arg == "--aoi-radius" && value(v)) cfg.aoiRadius = float(std::atof(v));
+        else if (arg == "--shards" && value(v)) cfg.shards = std::atoi(v);
+        else if (arg == "--workers" && value(v)) cfg.workers = std::atoi(v);
+        else if (arg == "--pin-server" && value(v)) cfg.placement.server = std::atoi(v);
+        else if (arg == "--pin-render" && value(v)) cfg.placement.render = std::atoi(v);
+        else if (arg == "--pin-io" && value(v)) cfg.placement.io = std::atoi(v);
+        else if (arg == "--busy-poll") cfg.placement.busyPoll = true;
+        else if (arg == "--pin-workers" && value(v)) {
+            // Comma-separated CPUs and inclusive ranges
+            cfg.placement.workers.clear();
+            for (const char* p = v; *p;) {
+                char* end = nullptr;
+                long lo = std::strtol(p, &end, 10), hi = lo;
+                if (end == p || lo < 0) return false;
+                if (*end == '-') { p = end + 1; hi = std::strtol(p, &end, 10); if (end == p || hi < lo || hi - lo > 4096) return false; }
+                for (long c = lo; c <= hi; c++) cfg.placement.workers.push_back(int(c));
+                if (*end == ',') end++;
+                else if (*end) return false;
+                p = end;
+            }
+            if (cfg.placement.workers.empty()) return false;
+        }
+        else if (arg == "--listen" && value(v)) cfg.listenPort = std::atoi(v);
+        else if (arg == "--client-id-base" && value(v)) cfg.clientIdBase = std::atoi(v);
+        else if (arg == "--seed" && value(v)) cfg.seed = uint32_t(std::strtoul(v, nullptr, 10));
+        else if (arg == "--record" && value(v)) cfg.recordPath = v;
+        else if (arg == "--replay" && value(v)) cfg.replayPath = v;
+        else if (arg == "--log-stats" && value(v)) cfg.logStatsPath = v;
+        else if (arg == "--from" && value(v)) cfg.fromTick = std::strtoull(v, nullptr, 10);
+        else if (arg == "--to" && value(v)) cfg.toTick = std::strtoull(v, nullptr, 10);
+        else if (arg == "--checkpoint" && value(v)) cfg.checkpointPath = v;
+        else if (arg == "--checkpoint-every" && value(v)) cfg.checkpointEvery = std::strtoull(v, nullptr, 10);
+        else if (arg == "--resume" && value(v)) cfg.resumePath = v;
+        else if (arg == "--resume-log" && value(v)) cfg.resumeLogPath = v;
+        else if (arg == "--stats-file" && value(v)) cfg.statsPath = v;
+        else if (arg == "--stats-interval-ms" && value(v)) cfg.statsIntervalMs = std::atoi(v);
+        else if (arg == "--connect" && value(v)) {
+            std::string hp = v;
+            size_t colon = hp.rfind(':');
+            if (colon == std::string::npos) return false;
+            cfg.connectHost = hp.substr(0, colon);
+            cfg.connectPort = std::atoi(hp.c_str() + colon + 1);
+            if (cfg.connectPort <= 0) return false;
+        }
+        else if (arg == "--cluster" && value(v)) {
+            cfg.clusterHosts.clear(); cfg.clusterPorts.clear();
+            std::string list = v;
+            for (size_t pos = 0; pos <= list.size();) {
+                size_t end = list.find(',', pos);
+                if (end == std::string::npos) end = list.size();
+                std::string hp = list.substr(pos, end - pos);
+                size_t colon = hp.rfind(':');
+                if (colon == std::string::npos || colon == 0) return false;
+                int port = std::atoi(hp.c_str() + colon + 1);
+                if (port <= 0 || port > 65535) return false;
+                cfg.clusterHosts.push_back(hp.substr(0, colon));
+                cfg.clusterPorts.push_back(port);
+                pos = end + 1;
+            }
+        }
+        else if (arg == "--node" && value(v)) cfg.node = std::atoi(v);
+        else if (arg == "--world" && value(v)) {
+            char* end = nullptr;
+            cfg.worldCols = cfg.worldRows = int(std::strtol(v, &end, 10));
+            if (*end == 'x') cfg.worldRows = int(std::strtol(end + 1, &end, 10));
+            if (*end) return false;
+            for (int d : { cfg.worldCols, cfg.worldRows })
+                if (d < 3 || d > MAX_WORLD_CELLS || d % 2 == 0) return false;
+        }
+        else if (arg == "--queue-policy" && value(v)) {
+            std::string p = v;
+            if (p == "block") cfg.queuePolicy = FullPolicy::Block;
+            else if (p == "drop-oldest") cfg.queuePolicy = FullPolicy::DropOldest;
+            else if (p == "reject") cfg.queuePolicy = FullPolicy::Reject;
+            else return false;
+        }
+        else if (arg == "--format" && value(v)) {
+            std::string f = v;
+            if (f == "csv") cfg.csv = true;
+            else if (f == "json") cfg.csv = false;
+            else return false;
+        }
+        else return false;
+    }
+    if (cfg.bench && !renderSet) cfg.render = false;
+    if (cfg.connectPort) cfg.render = false;
+    if (!cfg.replayPath.empty() || !cfg.logStatsPath.empty()) return cfg.shards > 0 && cfg.workers >= 0 && cfg.fromTick <= cfg.toTick;
+    if (cfg.checkpointEvery == 0 || (!cfg.resumeLogPath.empty() && cfg.resumePath.empty()) || cfg.statsIntervalMs <= 0) return false;
+    if (!cfg.clusterPorts.empty()) {
+        // Logs and checkpoints are one process's; they don't capture migrations
+        if (cfg.node < 0 || size_t(cfg.node) >= cfg.clusterPorts.size() || cfg.clusterPorts.size() > NO_NODE || cfg.connectPort ||
+            !cfg.recordPath.empty() || !cfg.checkpointPath.empty() || !cfg.resumePath.empty()) return false;
+        if (cfg.listenPort && cfg.listenPort != cfg.clusterPorts[size_t(cfg.node)]) return false;
+        cfg.listenPort = cfg.clusterPorts[size_t(cfg.node)];
+    }
+    return (cfg.clients > 0 || (cfg.listenPort > 0 && !cfg.benchWire)) && cfg.actionRate > 0 && cfg.tickHz > 0 && cfg.latencyMs >= 0 && cfg.durationSec > 0 && cfg.aoiRadius >= 0 &&
+           cfg.shards > 0 && cfg.workers >= 0;
+}
+
+struct Metric {
+    const char* name;
+    double value;
+    // Integral values print exactly, everything else with fixed precision
+    void print(FILE* f) const {
+        if (value == std::floor(value) && std::fabs(value) < 1e15) std::fprintf(f, "%.0f", value);
+        else std::fprintf(f, "%.3f", value);
+    }
+};
+
+#ifdef HAVE_UDP_TRANSPORT
+void UdpServerTransport::appendMetrics(std::vector<Metric>& m) const {
+    m.push_back({ "udp_packets_in", double(packetsIn) });
+    m.push_back({ "udp_bytes_in", double(bytesIn) });
+    m.push_back({ "udp_malformed", double(malformed) });
+    m.push_back({ "udp_snapshots_out", double(snapshotsOut) });
+    m.push_back({ "udp_snapshots_dropped", double(snapshotsDropped) });
+    if (clusterNode) {
+        m.push_back({ "udp_redirects_sent", double(redirectsSent) });
+        clusterNode->appendMetrics(m);
+    }
+}
+#endif
+
+void ClusterNode::appendMetrics(std::vector<Metric>& m) const {
+    size_t waiting = 0, unacked = 0;
+    for (const Peer& p : peers) { waiting += p.leaving.size(); unacked += p.nextBatch - 1 - p.acked; }
+    m.push_back({ "cluster_node", double(self) });
+    m.push_back({ "cluster_nodes", double(nodes) });
+    m.push_back({ "cluster_migrations_out", double(migrationsOut) });
+    m.push_back({ "cluster_migrations_in", double(migrationsIn) });
+    m.push_back({ "cluster_migrations_waiting", double(waiting) });
+    m.push_back({ "cluster_migration_batches", double(migrationBatches) });
+    m.push_back({ "cluster_migration_batches_unacked", double(unacked) });
+    m.push_back({ "cluster_migration_resends", double(migrationResends) });
+    m.push_back({ "cluster_forwards_out", double(forwardsOut) });
+    m.push_back({ "cluster_forwards_in", double(forwardsIn) });
+    m.push_back({ "cluster_forwards_dropped", double(forwardsDropped) });
+    m.push_back({ "cluster_redirects", double(redirectsQueued) });
+    m.push_back({ "cluster_border_updates", double(borderUpdates) });
+    m.push_back({ "cluster_border_datagrams", double(borderDatagrams) });
+    m.push_back({ "cluster_border_bytes", double(borderBytes) });
+    m.push_back({ "cluster_border_overflows", double(borderOverflows) });
+    m.push_back({ "cluster_ghosts", double(ghostCount()) });
+    m.push_back({ "cluster_peer_malformed", double(peerMalformed) });
+    m.push_back({ "cluster_peer_restarts", double(peerRestarts) });
+    m.push_back({ "cluster_largest_datagram_bytes", double(largestDatagram) });
+}
+
+// One flat JSON object, or long-form "metric,t_ms,value" CSV; depth is an optional time series
+void printMetrics(const std::vector<Metric>& metrics, bool csv, const std::vector<DepthSample>* depth) {
+    if (csv) {
+        std::printf("metric,t_ms,value\n");
+        for (auto& m : metrics) { std::printf("%s,,", m.name); m.print(stdout); std::printf("\n"); }
+        if (depth) for (auto& d : *depth) std::printf("queue_depth,%.1f,%zu\n", d.tMs, d.depth);
+        return;
+    }
+    std::printf("{");
+    for (size_t i = 0; i < metrics.size(); i++) {
+        std::printf("%s\"%s\":", i ? "," : "", metrics[i].name);
+        metrics[i].print(stdout);
+    }
+    if (depth) {
+        std::printf(",\"queue_depth\":[");
+        for (size_t i = 0; i < depth->size(); i++) std::printf("%s[%.1f,%zu]", i ? "," : "", (*depth)[i].tMs, (*depth)[i].depth);
+        std::printf("]");
+    }
+    std::printf("}\n");
+}
+
+#if AE_INSTRUMENT
+// Cost of one timed scope, measured on a private block so it isn't exported
+double scopedTimerCostNs() {
+    ThreadStats scratch;
+    const int n = 100000;
+    int64_t t0 = nowNs();
+    for (int i = 0; i < n; i++) ScopedStageTimer t(scratch, Stage::Tick);
+    return double(nowNs() - t0) / n;
+}
+
+// All threads' counters and stage histograms in the Prometheus text format.
+// The overhead ratio estimates time spent in the timers themselves against
+// the time they measured at top level.
+void writeStatsText(FILE* f, double timerCostNs) {
+    uint64_t counters[size_t(Counter::Count)] = {};
+    std::vector<LatencyHistogram> hists(size_t(Stage::Count));
+    uint64_t sums[size_t(Stage::Count)] = {};
+    {
+        std::lock_guard<std::mutex> lock(threadStatsMutex);
+        for (auto& ts : threadStatsBlocks) {
+            for (size_t c = 0; c < size_t(Counter::Count); c++) counters[c] += ts->counters[c].load(std::memory_order_relaxed);
+            for (size_t s = 0; s < size_t(Stage::Count); s++) {
+                const ThreadStats::StageHist* h = ts->stages[s].load(std::memory_order_acquire);
+                if (!h) continue;
+                for (size_t b = 0; b < LatencyHistogram::BUCKETS; b++)
+                    if (uint64_t n = h->buckets[b].load(std::memory_order_relaxed)) hists[s].addBucket(b, n);
+                hists[s].noteMax(int64_t(h->maxNs.load(std::memory_order_relaxed)));
+                sums[s] += h->sumNs.load(std::memory_order_relaxed);
+            }
+        }
+    }
+    for (size_t c = 0; c < size_t(Counter::Count); c++)
+        std::fprintf(f, "# TYPE ae_%s_total counter\nae_%s_total %llu\n", COUNTER_NAMES[c], COUNTER_NAMES[c], (unsigned long long)counters[c]);
+
+    std::fprintf(f, "# HELP ae_stage_seconds Wall time per hot-path stage invocation\n# TYPE ae_stage_seconds summary\n");
+    const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+    uint64_t timed = 0;
+    for (size_t s = 0; s < size_t(Stage::Count); s++) {
+        const LatencyHistogram& h = hists[s];
+        timed += h.count();
+        for (double q : quantiles)
+            std::fprintf(f, "ae_stage_seconds{stage=\"%s\",quantile=\"%g\"} %.9f\n", STAGE_NAMES[s], q, double(h.percentile(q)) / 1e9);
+        std::fprintf(f, "ae_stage_seconds_sum{stage=\"%s\"} %.9f\n", STAGE_NAMES[s], double(sums[s]) / 1e9);
+        std::fprintf(f, "ae_stage_seconds_count{stage=\"%s\"} %llu\n", STAGE_NAMES[s], (unsigned long long)h.count());
+    }
+    // Per client, only the ones that have lost actions: a scrape stays small with many clients
+    std::fprintf(f, "# HELP ae_ingress_lost_total Actions turned away at ingress, by client and reason\n# TYPE ae_ingress_lost_total counter\n");
+    ingress.forEachClient([&](const FairIngress::Client& c) {
+        uint64_t throttled = c.throttled.load(std::memory_order_relaxed), dropped = c.dropped.load(std::memory_order_relaxed);
+        if (throttled) std::fprintf(f, "ae_ingress_lost_total{client=\"%u\",reason=\"throttled\"} %llu\n", c.id, (unsigned long long)throttled);
+        if (dropped) std::fprintf(f, "ae_ingress_lost_total{client=\"%u\",reason=\"dropped\"} %llu\n", c.id, (unsigned long long)dropped);
+    });
+    std::fprintf(f, "# TYPE ae_stage_max_seconds gauge\n");
+    for (size_t s = 0; s < size_t(Stage::Count); s++)
+        std::fprintf(f, "ae_stage_max_seconds{stage=\"%s\"} %.9f\n", STAGE_NAMES[s], double(hists[s].max()) / 1e9);
+    // Tick, drain and render are the outermost scopes; the rest nest inside the tick
+    double measured = double(sums[size_t(Stage::Tick)] + sums[size_t(Stage::Drain)] + sums[size_t(Stage::Render)]);
+    std::fprintf(f, "# TYPE ae_instrumentation_overhead_ratio gauge\nae_instrumentation_overhead_ratio %.6f\n",
+                 measured > 0 ? double(timed) * timerCostNs / measured : 0.0);
+}
+
+// Rewrites the stats file every interval (write to PATH.tmp, then rename, so
+// a scraper such as node_exporter's textfile collector never reads half a
+// file) and once more on stop()
+class StatsExporter {
+    std::string path;
+    int intervalMs = 1000;
+    double timerCostNs = 0;
+    std::thread thread;
+    std::mutex m;
+    std::condition_variable cv;
+    bool stopping = false;
+
+    void writeOnce() {
+        std::string tmp = path + ".tmp";
+        FILE* f = std::fopen(tmp.c_str(), "w");
+        if (!f) return;
+        writeStatsText(f, timerCostNs);
+        if (std::fclose(f) == 0) {
+#ifdef _WIN32
+            std::remove(path.c_str());
+#endif
+            std::rename(tmp.c_str(), path.c_str());
+        }
+    }
+public:
+    ~StatsExporter() { stop(); }
+    void start(const std::string& p, int everyMs) {
+        path = p;
+        intervalMs = everyMs;
+        timerCostNs = scopedTimerCostNs();
+        thread = std::thread([this] {
+            pinThisThread(placement.io);
+            std::unique_lock<std::mutex> lock(m);
+            while (!cv.wait_for(lock, std::chrono::milliseconds(intervalMs), [&] { return stopping; })) writeOnce();
+        });
+    }
+    void stop() {
+        if (!thread.joinable()) return;
+        { std::lock_guard<std::mutex> lock(m); stopping = true; }
+        cv.notify_one();
+        thread.join();
+        writeOnce();
+    }
+};
+StatsExporter statsExporter;
+#endif
+
+// Benchmark report, either one flat JSON object or long-form "metric,t_ms,value" CSV
+void printReport(const SimConfig& cfg, double elapsedSec) {
+    auto qs = actionQueue.stats();
+    uint64_t replEntities = 0, replBytes = 0, naiveBytes = 0, maxClientBytes = 0;
+    size_t views = 0;
+    for (auto& v : clientViews) {
+        if (v.seq == 0) continue;
+        views++;
+        replEntities += v.entitiesSent; replBytes += v.bytesSent; naiveBytes += v.naiveBytes;
+        maxClientBytes = std::max(maxClientBytes, v.bytesSent);
+    }
+    double perClient = views ? 1.0 / double(views) : 0.0;
+    uint64_t shardMax = 0, shardTotal = 0, shardAllocs = 0;
+    size_t arenaPeak = tickArena.stats().peakBytes;
+    uint64_t arenaGrows = tickArena.stats().grows;
+    for (auto& sh : shards) {
+        shardMax = std::max(shardMax, sh.actions); shardTotal += sh.actions; shardAllocs += sh.heapAllocs;
+        arenaPeak = std::max(arenaPeak, sh.arena.stats().peakBytes); arenaGrows += sh.arena.stats().grows;
+    }
+    double shardMean = double(shardTotal) / double(shards.size());
+    uint64_t limitedClients = 0, worstLosses = 0;
+    uint32_t worstClient = 0;
+    ingress.forEachClient([&](const FairIngress::Client& c) {
+        uint64_t lost = c.throttled.load(std::memory_order_relaxed) + c.dropped.load(std::memory_order_relaxed);
+        if (lost) limitedClients++;
+        if (lost > worstLosses) { worstLosses = lost; worstClient = c.id; }
+    });
+    RuleCounters rules;
+    uint64_t jumps = 0;
+    for (auto& sh : shards) {
+        jumps += sh.launches;
+        for (size_t r = 0; r < RULE_COUNT; r++) rules.hits[r] += sh.rules.hits[r];
+        rules.throttles += sh.rules.throttles; rules.kicks += sh.rules.kicks;
+    }
+    LatencyHistogram poolLag = clientPool.lag();
+    std::vector<Metric> metrics = {
+        { "clients", double(cfg.clients) }, { "rate", cfg.actionRate }, { "tick_hz", double(cfg.tickHz) },
+        { "latency_ms", double(cfg.latencyMs) }, { "duration_s", elapsedSec },
+        { "actions_applied", double(actionsApplied) }, { "actions_per_sec", double(actionsApplied) / elapsedSec },
+        { "latency_samples", double(applyLatency.count()) },
+        { "latency_p50_us", applyLatency.percentile(0.50) / 1e3 }, { "latency_p99_us", applyLatency.percentile(0.99) / 1e3 },
+        { "latency_p999_us", applyLatency.percentile(0.999) / 1e3 }, { "latency_max_us", applyLatency.max() / 1e3 },
+        { "honest_latency_p99_us", honestLatency.percentile(0.99) / 1e3 }, { "honest_latency_max_us", honestLatency.max() / 1e3 },
+        { "client_rate_limit", cfg.clientRateLimit }, { "ingress_admitted", double(ingress.admittedCount()) },
+        { "ingress_throttled", double(ingress.throttledCount()) }, { "ingress_dropped", double(ingress.droppedCount()) },
+        { "ingress_clients_limited", double(limitedClients) }, { "ingress_worst_client", double(worstClient) },
+        { "ingress_worst_client_losses", double(worstLosses) },
+        { "client_pool_threads", double(clientPool.threads()) }, { "client_pool_steps", double(clientPool.steps()) },
+        { "client_pool_steps_per_sec", double(clientPool.steps()) / elapsedSec },
+        { "client_pool_lag_p50_us", poolLag.percentile(0.50) / 1e3 }, { "client_pool_lag_p99_us", poolLag.percentile(0.99) / 1e3 },
+        { "client_pool_lag_max_us", double(clientPool.maxLagNs()) / 1e3 },
+        { "shots_fired", double(shotsFired) }, { "shots_hit", double(shotsHit) },
+        { "shot_candidates_per_shot", shotsFired ? double(shotCandidates) / double(shotsFired) : 0.0 },
+        { "shot_rewind_ticks_mean", shotsFired ? double(shotRewindTicks) / double(shotsFired) : 0.0 },
+        { "queue_pushed", double(qs.pushed) }, { "queue_blocked", double(qs.blocked) },
+        { "queue_dropped_oldest", double(qs.droppedOldest) }, { "queue_rejected", double(qs.rejected) },
+        { "aoi_radius", double(cfg.aoiRadius) }, { "world_cols", double(world.width()) }, { "world_rows", double(world.height()) },
+        { "replicated_entities", double(replEntities) }, { "replicated_bytes", double(replBytes) },
+        { "replicated_entities_per_client", double(replEntities) * perClient },
+        { "replicated_bytes_per_client", double(replBytes) * perClient },
+        { "replicated_bytes_per_client_max", double(maxClientBytes) },
+        { "replicated_bytes_naive", double(naiveBytes) },
+        { "shards", double(shards.size()) }, { "shard_workers", double(shardScheduler.size()) },
+        { "shard_handoffs", double(shardHandoffs) }, { "shard_steals", double(shardScheduler.steals.load()) },
+        { "shard_load_imbalance", shardMean > 0 ? double(shardMax) / shardMean : 0.0 }, // busiest shard / mean
+        { "busy_poll", placement.busyPoll ? 1.0 : 0.0 }, { "threads_pinned", double(threadsPinned.load()) },
+        { "pin_failures", double(pinFailures.load()) },
+        { "tick_wake_late_p50_us", tickWakeLate.percentile(0.50) / 1e3 }, { "tick_wake_late_p99_us", tickWakeLate.percentile(0.99) / 1e3 },
+        { "tick_wake_late_max_us", tickWakeLate.max() / 1e3 },
+        { "steady_ticks", double(steadyTicks) }, { "tick_heap_allocs", double(tickHeapAllocs + shardAllocs) },
+        { "ticks_with_heap_allocs", double(ticksWithHeapAllocs) }, { "heap_allocs_counted", double(AE_INSTRUMENT) },
+        { "tick_arena_peak_bytes", double(arenaPeak) }, { "tick_arena_grows", double(arenaGrows) },
+        { "prediction_reconciles", double(predictionReconciles.load()) },
+        { "prediction_corrections", double(predictionCorrections.load()) },
+        { "prediction_vertical_corrections", double(verticalCorrections.load()) },
+        { "jumps_launched", double(jumps) },
+        { "input_ring_overflows", double(inputRingOverflows.load()) },
+        { "keyframes_sent", double(keyframesSent) }, { "keyframe_bytes", double(keyframeBytes) },
+        { "cheaters", double(cfg.cheaters) }, { "rule_throttles", double(rules.throttles) }, { "rule_kicks", double(rules.kicks) },
+        { "dropped_throttled", double(droppedThrottled) }, { "dropped_kicked", double(droppedKicked) },
+        { "checkpoints_written", double(checkpointWriter.written.load()) },
+        { "checkpoints_failed", double(checkpointWriter.failed.load()) },
+        { "checkpoints_superseded", double(checkpointWriter.superseded.load()) },
+        { "checkpoint_bytes", double(checkpointWriter.lastBytes.load()) },
+        { "resume_tick", double(resumeTick) }, { "resume_tail_records", double(resumeTailRecords) }, { "resume_ms", resumeMs },
+    };
+    std::deque<std::string> names; // Metric only points at its name
+    for (size_t r = 0; r < RULE_COUNT; r++) {
+        names.push_back(std::string("rule_") + RULES[r].name + "_hits");
+        metrics.push_back({ names.back().c_str(), double(rules.hits[r]) });
+    }
+    serverTransport->appendMetrics(metrics);
+    printMetrics(metrics, cfg.csv, &queueDepthSamples);
+}
+
+// Size and throughput of the delta wire format against the naive float
+// encoding, on a fixed-seed world where a quarter of the entities move per frame
+void runWireBenchmark(const SimConfig& cfg) {
+    const uint32_t entities = uint32_t(cfg.clients);
+    const int frames = 2000;
+    const uint32_t ackLag = 4; // frames between a snapshot and its ack
+    std::mt19937 gen(1234);
+    const float ext = std::min(world.extentX(), world.extentY());
+    std::uniform_real_distribution<float> pos(-ext, ext), step(-0.2f, 0.2f);
+    std::uniform_int_distribution<uint32_t> pick(0, entities - 1);
+
+    std::vector<std::vector<QuantEntity>> history(ackLag + 1, std::vector<QuantEntity>(entities));
+    std::vector<float> x(entities), y(entities);
+    for (uint32_t i = 0; i < entities; i++) { x[i] = pos(gen); y[i] = pos(gen); }
+    std::vector<uint8_t> packet(32 + size_t(entities) * 16);
+    std::vector<QuantEntity> decoded(entities);
+
+    uint64_t deltaBytes = 0, naiveBytes = 0;
+    double deltaEncNs = 0, deltaDecNs = 0, naiveEncNs = 0, naiveDecNs = 0;
+    bool roundTrip = true;
+    for (int f = 1; f <= frames; f++) {
+        for (uint32_t m = 0; m < entities / 4; m++) {
+            uint32_t i = pick(gen);
+            x[i] = std::max(-ext, std::min(ext, x[i] + step(gen)));
+            y[i] = std::max(-ext, std::min(ext, y[i] + step(gen)));
+        }
+        std::vector<QuantEntity>& cur = history[f % history.size()];
+        for (uint32_t i = 0; i < entities; i++) cur[i] = quantizeEntity(i + 1, x[i], y[i], 0.0f);
+        SnapshotSpan span = { uint32_t(f), cur.data(), entities };
+        const std::vector<QuantEntity>& b = history[(f + history.size() - ackLag) % history.size()];
+        SnapshotSpan base = { uint32_t(f) - ackLag, b.data(), entities };
+        const SnapshotSpan* basePtr = f > int(ackLag) ? &base : nullptr;
+
+        int64_t t0 = nowNs();
+        size_t n = encodeSnapshot(span, basePtr, packet.data(), packet.size());
+        int64_t t1 = nowNs();
+        uint32_t count = 0, seq = 0;
+        roundTrip &= decodeSnapshot(packet.data(), n, basePtr, decoded.data(), entities, count, seq);
+        int64_t t2 = nowNs();
+        roundTrip &= count == entities && std::equal(cur.begin(), cur.end(), decoded.begin(),
+                                                     [](const QuantEntity& a, const QuantEntity& c) { return a.id == c.id && a.sameState(c); });
+        deltaBytes += n; deltaEncNs += double(t1 - t0); deltaDecNs += double(t2 - t1);
+
+        t0 = nowNs();
+        n = encodeSnapshotNaive(span, packet.data(), packet.size());
+        t1 = nowNs();
+        roundTrip &= decodeSnapshotNaive(packet.data(), n, decoded.data(), entities, count, seq);
+        t2 = nowNs();
+        naiveBytes += n; naiveEncNs += double(t1 - t0); naiveDecNs += double(t2 - t1);
+    }
+
+    double snaps = double(frames), ents = double(frames) * entities;
+    std::vector<Metric> metrics = {
+        { "entities", double(entities) }, { "frames", snaps }, { "ack_lag", double(ackLag) },
+        { "round_trip_ok", roundTrip ? 1.0 : 0.0 },
+        { "delta_bytes_per_snapshot", double(deltaBytes) / snaps }, { "naive_bytes_per_snapshot", double(naiveBytes) / snaps },
+        { "compression_ratio", double(naiveBytes) / double(deltaBytes) },
+        { "delta_encode_mentities_per_sec", ents / deltaEncNs * 1e3 }, { "delta_decode_mentities_per_sec", ents / deltaDecNs * 1e3 },
+        { "naive_encode_mentities_per_sec", ents / naiveEncNs * 1e3 }, { "naive_decode_mentities_per_sec", ents / naiveDecNs * 1e3 },
+    };
+    printMetrics(metrics, cfg.csv, nullptr);
+}
+
+// The original action and its validation against std::map state, kept as the
+// baseline --bench-micro measures the batched paths against
+struct LegacyAction {
+    int clientID;
+    std::string type;
+    float dx, dy, dz;
+    int gx, gy;
+    bool illegal;
+};
+
+bool validateLegacyAction(std::map<int, std::tuple<float, float, float>>& state, LegacyAction& a) {
+    float x = std::get<0>(state[a.clientID]);
+    float y = std::get<1>(state[a.clientID]);
+    float nx = x, ny = y;
+    if (a.type == "Move") { nx += a.dx; ny += a.dy; }
+    int gx = std::round(nx) + world.extentX();
+    int gy = world.height() - 1 - (std::round(ny) + world.extentY());
+    a.gx = gx; a.gy = gy;
+    if (nx < -world.extentX() || nx > world.extentX() || ny < -world.extentY() || ny > world.extentY()) { a.illegal = true; return false; }
+    return true;
+}
+
+// The original renderer: a grid of per-cell color strings streamed whole every
+// frame. It wrote to std::cout; the benchmark passes a string stream instead.
+void renderLegacyFrame(std::ostream& out, int cols, int rows, const std::vector<LegacyAction>& history,
+                       const std::map<int, std::tuple<float, float, float>>& predicted, const std::map<int, int>& penalties) {
+    const std::string RESET = "\033[0m", RED = "\033[31m", GREEN = "\033[32m", YELLOW = "\033[33m";
+    const std::string MAGENTA = "\033[35m", CYAN = "\033[36m", GRAY = "\033[90m";
+    std::vector<std::string> grid(cols * rows, ".");
+    int historySize = int(history.size());
+    for (int i = 0; i < historySize; i++) {
+        auto& act = history[i];
+        int idx = act.gy * cols + act.gx;
+        if (idx < 0 || idx >= cols * rows) continue;
+
+        float age = float(historySize - i) / historySize;
+        std::string color;
+        if (act.illegal) color = MAGENTA;
+        else if (act.type == "Move") color = GREEN;
+        else if (act.type == "Jump") color = YELLOW;
+        else if (act.type == "Shoot") color = RED;
+
+        if (age < 0.33f) color = GRAY;
+        else if (age < 0.66f) color = "\033[2m" + color;
+
+        if (act.illegal) grid[idx] = color + "X" + RESET;
+        else if (act.type == "Move") grid[idx] = color + "M" + RESET;
+        else if (act.type == "Jump") grid[idx] = color + "J" + RESET;
+        else if (act.type == "Shoot") grid[idx] = color + "S" + RESET;
+    }
+    for (auto& kv : predicted) {
+        int gx = worldCellX(world, std::get<0>(kv.second));
+        int gy = worldCellY(world, std::get<1>(kv.second));
+        if (gx >= 0 && gx < cols && gy >= 0 && gy < rows) grid[gy * cols + gx] = CYAN + std::to_string(kv.first) + RESET;
+    }
+
+    out << "\033[H";
+    out << "=== ASCII Game Map (Live) ===\n";
+    for (int y = 0; y < rows; y++) {
+        for (int x = 0; x < cols; x++) out << grid[y * cols + x] << " ";
+        out << "\n";
+    }
+    out << "\nPenalties: ";
+    for (auto& p : penalties) out << "Client " << p.first << "=" << p.second << " ";
+    out << "\n" << std::flush;
+}
+
+// Core primitives in isolation, each beside the implementation it replaced:
+// the mutex TSQueue, std::map state, vector::erase history, per-action
+// validation against a map, string-grid frames, scalar validation and
+// nearest-neighbour scans. Inputs come from fixed seeds so runs are comparable.
+void runMicroBenchmark(const SimConfig& cfg) {
+    std::vector<Metric> metrics;
+    std::deque<std::string> names; // Metric only points at its name
+    auto add = [&](const std::string& name, double v) { names.push_back(name); metrics.push_back({ names.back().c_str(), v }); };
+    std::mt19937 gen(1234);
+    const float ext = std::min(world.extentX(), world.extentY());
+    double sink = 0; // consumed below so no loop is optimized away
+
+    // Queue: producers push tagged items, the calling thread pops them all
+    const size_t queueItems = 1 << 18;
+    auto runQueue = [&](int producers, auto&& push, auto&& pop) {
+        int64_t t0 = nowNs();
+        std::vector<std::thread> pool;
+        for (int p = 0; p < producers; p++)
+            pool.emplace_back([&, p] {
+                QueuedAction q = {};
+                q.action.clientID = uint32_t(p);
+                for (size_t i = size_t(p); i < queueItems; i += size_t(producers)) { q.submitNs = int64_t(i); push(q); }
+            });
+        uint64_t got = 0, sum = 0;
+        while (got < queueItems) if (!pop(got, sum)) std::this_thread::yield();
+        for (auto& t : pool) t.join();
+        double ns = double(nowNs() - t0);
+        return sum == uint64_t(queueItems) * (queueItems - 1) / 2 ? ns : -1.0;
+    };
+    bool queueOk = true;
+    for (int producers : { 1, 4, 16 }) {
+        TSQueue<QueuedAction> ts;
+        double tsNs = runQueue(producers, [&](const QueuedAction& q) { ts.push(q); }, [&](uint64_t& got, uint64_t& sum) {
+            QueuedAction q;
+            if (!ts.try_pop(q)) return false;
+            got++; sum += uint64_t(q.submitNs);
+            return true;
+        });
+        MPSCRing<QueuedAction> ring(ACTION_QUEUE_CAPACITY, FullPolicy::Block);
+        QueuedAction batch[ACTION_BATCH];
+        double ringNs = runQueue(producers, [&](const QueuedAction& q) { ring.push(q); }, [&](uint64_t& got, uint64_t& sum) {
+            size_t n = ring.try_pop_n(batch, ACTION_BATCH);
+            for (size_t i = 0; i < n; i++) sum += uint64_t(batch[i].submitNs);
+            got += n;
+            return n > 0;
+        });
+        queueOk &= tsNs > 0 && ringNs > 0;
+        std::string p = std::to_string(producers);
+        add("queue_tsqueue_p" + p + "_mitems_per_sec", double(queueItems) / tsNs * 1e3);
+        add("queue_mpsc_p" + p + "_mitems_per_sec", double(queueItems) / ringNs * 1e3);
+        add("queue_mpsc_p" + p + "_speedup", tsNs / ringNs);
+    }
+    add("queue_ok", queueOk ? 1.0 : 0.0);
+
+    // Validation: one batch of entities through the original per-action map
+    // lookup, the scalar reference and the vector path
+    {
+        const size_t n = 4096, reps = 2000;
+        std::uniform_real_distribution<float> pos(-ext, ext), step(-1.0f, 1.0f);
+        std::vector<float> x(n), y(n), dx(n), dy(n), nx(n), ny(n), nx2(n), ny2(n);
+        std::vector<int32_t> gx(n), gy(n), gx2(n), gy2(n);
+        std::vector<uint8_t> bad(n), bad2(n);
+        for (size_t i = 0; i < n; i++) { x[i] = pos(gen); y[i] = pos(gen); dx[i] = step(gen); dy[i] = step(gen); }
+        std::map<int, std::tuple<float, float, float>> state;
+        std::vector<LegacyAction> legacy(n);
+        for (size_t i = 0; i < n; i++) {
+            state[int(i)] = std::make_tuple(x[i], y[i], 0.0f);
+            legacy[i] = { int(i), "Move", dx[i], dy[i], 0.0f, 0, 0, false };
+        }
+        int64_t tm = nowNs();
+        for (size_t r = 0; r < reps; r++) {
+            for (LegacyAction& a : legacy) a.illegal = !validateLegacyAction(state, a);
+            sink += legacy[r % n].illegal;
+        }
+        int64_t t0 = nowNs();
+        for (size_t r = 0; r < reps; r++) {
+            validateMovesScalar(x.data(), y.data(), dx.data(), dy.data(), n, nx.data(), ny.data(), gx.data(), gy.data(), bad.data());
+            sink += bad[r % n];
+        }
+        int64_t t1 = nowNs();
+        for (size_t r = 0; r < reps; r++) {
+            validateMoves(x.data(), y.data(), dx.data(), dy.data(), n, nx2.data(), ny2.data(), gx2.data(), gy2.data(), bad2.data());
+            sink += bad2[r % n];
+        }
+        int64_t t2 = nowNs();
+        bool same = nx == nx2 && ny == ny2 && gx == gx2 && gy == gy2 && bad == bad2;
+        bool mapSame = true;
+        for (size_t i = 0; i < n; i++) mapSame &= legacy[i].gx == gx[i] && legacy[i].gy == gy[i] && legacy[i].illegal == (bad[i] != 0);
+        // The vector path again with the world's bounds as runtime values, against withWorld's specialization
+        for (size_t r = 0; r < reps; r++) {
+            validateMovesIn(world, x.data(), y.data(), dx.data(), dy.data(), n, nx2.data(), ny2.data(), gx2.data(), gy2.data(), bad2.data());
+            sink += bad2[r % n];
+        }
+        int64_t t3 = nowNs();
+        same &= nx == nx2 && ny == ny2 && gx == gx2 && gy == gy2 && bad == bad2;
+        double ents = double(n * reps);
+        add("validate_map_mentities_per_sec", ents / double(t0 - tm) * 1e3);
+        add("validate_scalar_mentities_per_sec", ents / double(t1 - t0) * 1e3);
+        add("validate_simd_mentities_per_sec", ents / double(t2 - t1) * 1e3);
+        add("validate_simd_speedup", double(t1 - t0) / double(t2 - t1));
+        add("validate_simd_speedup_vs_map", double(t0 - tm) / double(t2 - t1));
+        add("validate_runtime_world_mentities_per_sec", ents / double(t3 - t2) * 1e3);
+        add("validate_simd_matches", same ? 1.0 : 0.0);
+        add("validate_map_matches", mapSame ? 1.0 : 0.0);
+#if defined(__AVX2__)
+        add("validate_simd_lanes", 8);
+#elif defined(__SSE2__) || defined(__ARM_NEON)
+        add("validate_simd_lanes", 4);
+#else
+        add("validate_simd_lanes", 1); // no vector path in this build
+#endif
+    }
+
+    // Render: a history that advances one action and one client move per
+    // frame, streamed by the original string-grid renderer, built as a full
+    // redraw and as a diff against the previous frame
+    {
+        const int frames = 2000;
+        const uint32_t clients = 16;
+        std::uniform_int_distribution<int> cell(0, std::min(world.width(), world.height()) - 1), kind(0, 2);
+        std::uniform_real_distribution<float> pos(-ext, ext);
+        auto randomEntry = [&] {
+            HistoryEntry h = {};
+            h.action.clientID = 1 + uint32_t(cell(gen)) % clients;
+            h.action.kind = ActionKind(kind(gen));
+            h.gx = int16_t(cell(gen)); h.gy = int16_t(cell(gen));
+            return h;
+        };
+        RenderSnapshot snap;
+        for (int i = 0; i < HISTORY_LIMIT; i++) snap.history.push_back(randomEntry());
+        for (uint32_t c = 1; c <= clients; c++) { snap.ids.push_back(c); snap.x.push_back(pos(gen)); snap.y.push_back(pos(gen)); }
+        {
+            auto toLegacy = [](const HistoryEntry& h) {
+                return LegacyAction{ int(h.action.clientID), actionName(h.action.kind), 0.0f, 0.0f, 0.0f, h.gx, h.gy, h.action.illegal() };
+            };
+            std::vector<LegacyAction> history;
+            for (const HistoryEntry& h : snap.history) history.push_back(toLegacy(h));
+            std::map<int, std::tuple<float, float, float>> predicted;
+            for (size_t i = 0; i < snap.ids.size(); i++) predicted[int(snap.ids[i])] = std::make_tuple(snap.x[i], snap.y[i], 0.0f);
+            const std::map<int, int> penalties;
+            const TerminalRenderer view = makeRenderView("bench"); // the same window as the renderers below
+            std::ostringstream out;
+            uint64_t bytes = 0;
+            int64_t t0 = nowNs();
+            for (int f = 0; f < frames; f++) {
+                history.erase(history.begin());
+                history.push_back(toLegacy(randomEntry()));
+                std::get<0>(predicted[int(1 + f % clients)]) = pos(gen);
+                out.str(std::string());
+                renderLegacyFrame(out, view.cols(), view.rows(), history, predicted, penalties);
+                bytes += uint64_t(out.tellp());
+            }
+            double ns = double(nowNs() - t0);
+            add("render_legacy_us_per_frame", ns / frames / 1e3);
+            add("render_legacy_bytes_per_frame", double(bytes) / frames);
+        }
+        for (int full = 1; full >= 0; full--) {
+            TerminalRenderer renderer = makeRenderView("bench");
+            uint64_t bytes = 0;
+            int64_t t0 = nowNs();
+            for (int f = 0; f < frames; f++) {
+                snap.history.erase(snap.history.begin());
+                snap.history.push_back(randomEntry());
+                snap.x[size_t(f) % clients] = pos(gen);
+                if (full) renderer.invalidate();
+                composeFrame(renderer, snap);
+                renderer.build();
+                bytes += renderer.lastFrameBytes();
+            }
+            double ns = double(nowNs() - t0);
+            const char* mode = full ? "full" : "diff";
+            add(std::string("render_") + mode + "_us_per_frame", ns / frames / 1e3);
+            add(std::string("render_") + mode + "_bytes_per_frame", double(bytes) / frames);
+        }
+    }
+
+    // History append with eviction: vector::erase(begin) against the ring
+    for (size_t cap : { size_t(HISTORY_LIMIT), size_t(1000) }) {
+        const size_t ops = 200000;
+        HistoryEntry h = {};
+        std::vector<HistoryEntry> vec;
+        int64_t t0 = nowNs();
+        for (size_t i = 0; i < ops; i++) {
+            h.action.seq = uint32_t(i);
+            vec.push_back(h);
+            if (vec.size() > cap) vec.erase(vec.begin());
+        }
+        int64_t t1 = nowNs();
+        HistoryRing<HistoryEntry> ring(cap);
+        for (size_t i = 0; i < ops; i++) { h.action.seq = uint32_t(i); ring.push_back(h); }
+        int64_t t2 = nowNs();
+        sink += vec.front().action.seq + ring[0].action.seq;
+        std::string c = std::to_string(cap);
+        add("history_vector_cap" + c + "_mappends_per_sec", double(ops) / double(t1 - t0) * 1e3);
+        add("history_ring_cap" + c + "_mappends_per_sec", double(ops) / double(t2 - t1) * 1e3);
+    }
+
+    // State lookups by client ID: std::map of tuples against EntityStore
+    for (uint32_t entities : { 1024u, 16384u }) {
+        const size_t lookups = 1 << 20;
+        std::uniform_int_distribution<uint32_t> pick(1, entities);
+        std::vector<uint32_t> order(lookups);
+        for (auto& id : order) id = pick(gen);
+        std::map<int, std::tuple<float, float, float>> m;
+        EntityStore st;
+        for (uint32_t id = 1; id <= entities; id++) { m[int(id)] = std::make_tuple(0.0f, 0.0f, 0.0f); st.add(id); }
+        int64_t t0 = nowNs();
+        for (uint32_t id : order) std::get<0>(m[int(id)]) += 1.0f;
+        int64_t t1 = nowNs();
+        for (uint32_t id : order) st.x[st.indexOf(id)] += 1.0f;
+        int64_t t2 = nowNs();
+        sink += std::get<0>(m[1]) + st.x[st.indexOf(1)];
+        std::string e = std::to_string(entities);
+        add("state_map_e" + e + "_mlookups_per_sec", double(lookups) / double(t1 - t0) * 1e3);
+        add("state_soa_e" + e + "_mlookups_per_sec", double(lookups) / double(t2 - t1) * 1e3);
+    }
+
+    // Nearest neighbour: the grid's ring search against a scan of every
+    // entity, over a field large enough for the cells to matter
+    {
+        const float half = 128.0f, cell = 4.0f, radius = 16.0f;
+        const int cells = int(2 * half / cell);
+        const size_t queries = 1 << 16;
+        std::uniform_real_distribution<float> pos(-half, half);
+        bool nearestOk = true;
+        for (uint32_t entities : { 256u, 4096u }) {
+            SpatialGrid grid(-half, -half, cell, cells, cells);
+            std::vector<float> ex(entities), ey(entities);
+            for (uint32_t id = 0; id < entities; id++) { ex[id] = pos(gen); ey[id] = pos(gen); grid.update(id, ex[id], ey[id]); }
+            std::vector<float> qx(queries), qy(queries);
+            for (size_t q = 0; q < queries; q++) { qx[q] = pos(gen); qy[q] = pos(gen); }
+            std::vector<uint32_t> scanned(queries), indexed(queries);
+            int64_t t0 = nowNs();
+            for (size_t q = 0; q < queries; q++) {
+                uint32_t best = NO_ENTITY;
+                float bestD2 = radius * radius;
+                for (uint32_t id = 0; id < entities; id++) {
+                    float ddx = ex[id] - qx[q], ddy = ey[id] - qy[q], d2 = ddx * ddx + ddy * ddy;
+                    if (d2 <= bestD2) { bestD2 = d2; best = id; }
+                }
+                scanned[q] = best;
+            }
+            int64_t t1 = nowNs();
+            for (size_t q = 0; q < queries; q++) indexed[q] = grid.nearest(qx[q], qy[q], radius);
+            int64_t t2 = nowNs();
+            // Ties may pick different IDs, so compare distances
+            auto dist2 = [&](size_t q, uint32_t id) {
+                if (id == NO_ENTITY) return -1.0f;
+                float ddx = ex[id] - qx[q], ddy = ey[id] - qy[q];
+                return ddx * ddx + ddy * ddy;
+            };
+            for (size_t q = 0; q < queries; q++) nearestOk &= dist2(q, scanned[q]) == dist2(q, indexed[q]);
+            sink += scanned[queries / 2] != NO_ENTITY ? scanned[queries / 2] : 0;
+            std::string e = std::to_string(entities);
+            add("nearest_scan_e" + e + "_mqueries_per_sec", double(queries) / double(t1 - t0) * 1e3);
+            add("nearest_grid_e" + e + "_mqueries_per_sec", double(queries) / double(t2 - t1) * 1e3);
+        }
+        add("nearest_matches", nearestOk ? 1.0 : 0.0);
+    }
+
+    add("checksum", double(int64_t(sink) & 0xFFFF));
+    printMetrics(metrics, cfg.csv, nullptr);
+}
+
+// Reads a checkpoint file into serverState; tick is the last tick it covers
+bool loadCheckpoint(const std::string& path, uint64_t& tick) {
+    FILE* f = std::fopen(path.c_str(), "rb");
+    if (!f) { std::fprintf(stderr, "cannot read checkpoint %s\n", path.c_str()); return false; }
+    std::vector<uint8_t> buf;
+    uint8_t chunk[65536];
+    size_t n;
+    while ((n = std::fread(chunk, 1, sizeof(chunk), f)) > 0) buf.insert(buf.end(), chunk, chunk + n);
+    std::fclose(f);
+    std::lock_guard<std::mutex> lock(stateMutex);
+    if (!decodeCheckpoint(buf.data(), buf.size(), serverState, positionHistory, tick)) { std::fprintf(stderr, "corrupt checkpoint %s, or taken with another --world\n", path.c_str()); return false; }
+    // The first tick's shots query the index before that tick publishes anything.
+    // Entities caught mid-jump go to their shards now: they have to keep
+    // falling whether or not their clients act again.
+    for (size_t i = 0; i < serverState.size(); i++) {
+        if (!serverState.alive[i]) continue;
+        spatialIndex.update(serverState.ids[i], serverState.x[i], serverState.y[i]);
+        if (serverState.z[i] != 0.0f) ownerShard(serverState.ids[i]);
+    }
+    serverTick = tick;
+    return true;
+}
+
+// Re-simulates one logged tick; true when serverState hashes to the recorded checksum.
+// The unlogged ticks since the previous one are run first while anything is
+// still in the air, as the live server ran them.
+bool replayTickRecord(const TickRecord& rec, std::vector<QueuedAction>& arrived) {
+    arrived.clear();
+    for (;;) {
+        size_t up = 0;
+        for (const Shard& sh : shards) up += sh.airborne;
+        if (!up || serverTick + 1 >= rec.tick) break;
+        serverTick++;
+        simulateTick(arrived);
+        tickArena.reset();
+    }
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        for (uint32_t id : rec.joins) joinEntity(id);
+    }
+    int64_t now = nowNs();
+    arrived.clear();
+    for (GameAction a : rec.actions) {
+        a.flags = 0; // the verdict is recomputed
+        arrived.push_back({ a, now });
+    }
+    serverTick = rec.tick;
+    simulateTick(arrived);
+    tickArena.reset();
+    return stateChecksum(serverState) == rec.checksum;
+}
+
+// Live --resume: restores the checkpoint, then re-simulates the records after
+// it from --resume-log so the server carries on from the last logged tick.
+// Recovery time is bounded by the checkpoint interval, not the log length.
+bool resumeServer(const SimConfig& cfg) {
+    int64_t t0 = nowNs();
+    if (!loadCheckpoint(cfg.resumePath, resumeTick)) return false;
+    uint64_t last = resumeTick;
+    if (!cfg.resumeLogPath.empty()) {
+        TickLogReader log;
+        if (!log.open(cfg.resumeLogPath)) { std::fprintf(stderr, "cannot read tick log %s\n", cfg.resumeLogPath.c_str()); return false; }
+        if (log.worldCols != world.width() || log.worldRows != world.height()) {
+            std::fprintf(stderr, "tick log %s was recorded in a %ux%u world\n", cfg.resumeLogPath.c_str(), unsigned(log.worldCols), unsigned(log.worldRows));
+            return false;
+        }
+        if (bool(log.flags & TICK_LOG_SCATTER_SPAWNS) != scatterSpawns) {
+            std::fprintf(stderr, "tick log %s was recorded with --spawn %s\n", cfg.resumeLogPath.c_str(), scatterSpawns ? "origin" : "scatter");
+            return false;
+        }
+        TickRecord rec;
+        std::vector<QueuedAction> arrived;
+        TickLogReader::Cursor cur = log.seek(resumeTick + 1);
+        while (cur.next(rec)) {
+            if (!replayTickRecord(rec, arrived)) {
+                std::fprintf(stderr, "tick log %s diverges from checkpoint at tick %llu\n", cfg.resumeLogPath.c_str(), (unsigned long long)rec.tick);
+                return false;
+            }
+            last = rec.tick;
+            resumeTailRecords++;
+        }
+    }
+    serverTick = last + 1;
+    resumeMs = double(nowNs() - t0) / 1e6;
+    std::fprintf(stderr, "resumed at tick %llu: checkpoint tick %llu + %llu log records in %.1f ms\n",
+                 (unsigned long long)serverTick, (unsigned long long)resumeTick, (unsigned long long)resumeTailRecords, resumeMs);
+    return true;
+}
+
+// Feeds ticks [from, to] of a log back through simulateTick as fast as it
+// will go, checking serverState against the recorded checksum after every
+// record. With --resume the world starts from the checkpoint and the range
+// from the tick after it. Otherwise a range that starts after the first
+// record begins from an empty world, so its checksums can't match and aren't
+// checked. Returns the process exit code: 0 when every checked checksum matched.
+int runReplay(const SimConfig& cfg) {
+    TickLogReader log;
+    if (!log.open(cfg.replayPath)) { std::fprintf(stderr, "cannot read tick log %s\n", cfg.replayPath.c_str()); return 1; }
+    configureWorld(log.worldCols, log.worldRows); // the log's world, rule windows and spawns, whatever the flags say
+    ruleLimits.windowTicks = log.tickHz;
+    tickSeconds = 1.0f / float(log.tickHz);
+    scatterSpawns = (log.flags & TICK_LOG_SCATTER_SPAWNS) != 0;
+    TickRecord rec;
+    std::vector<QueuedAction> arrived;
+    uint64_t records = 0, actions = 0, rejected = 0, mismatches = 0, firstTick = 0, lastTick = 0, firstMismatch = 0;
+    int64_t t0 = nowNs();
+    uint64_t from = cfg.fromTick;
+    bool verify = from <= log.firstTick;
+    if (!cfg.resumePath.empty()) {
+        if (!loadCheckpoint(cfg.resumePath, resumeTick)) return 1;
+        verify = from <= resumeTick + 1;
+        from = std::max(from, resumeTick + 1);
+    }
+    TickLogReader::Cursor cur = log.seek(from);
+    while (cur.next(rec) && rec.tick <= cfg.toTick) {
+        if (records == 0) firstTick = rec.tick;
+        lastTick = rec.tick;
+        for (const GameAction& a : rec.actions) rejected += a.illegal();
+        if (!replayTickRecord(rec, arrived) && verify && mismatches++ == 0) firstMismatch = rec.tick;
+        records++;
+        actions += rec.actions.size();
+    }
+    double elapsed = double(nowNs() - t0) / 1e9;
+    double recorded = records ? double(lastTick - firstTick + 1) / double(log.tickHz) : 0.0;
+    std::vector<Metric> metrics = {
+        { "records", double(records) }, { "actions", double(actions) }, { "rejected", double(rejected) },
+        { "tick_hz", double(log.tickHz) }, { "seed", double(log.seed) }, { "shards", double(shards.size()) },
+        { "world_cols", double(log.worldCols) }, { "world_rows", double(log.worldRows) },
+        { "first_tick", double(firstTick) }, { "last_tick", double(lastTick) }, { "log_indexed", log.indexed ? 1.0 : 0.0 },
+        { "recorded_s", recorded }, { "replay_s", elapsed },
+        { "speedup", elapsed > 0 ? recorded / elapsed : 0.0 }, { "verified", verify ? 1.0 : 0.0 },
+        { "checksum_mismatches", double(mismatches) }, { "first_mismatch_tick", double(firstMismatch) },
+        { "checkpoint_tick", cfg.resumePath.empty() ? 0.0 : double(resumeTick) },
+        { "shots_fired", double(shotsFired) }, { "shots_hit", double(shotsHit) },
+    };
+    printMetrics(metrics, cfg.csv, nullptr);
+    return mismatches ? 2 : 0;
+}
+
+// Per-range totals from a log scan
+struct LogStats {
+    uint64_t records = 0, actions = 0, rejected = 0, joins = 0;
+    uint64_t byKind[size_t(ActionKind::Count)] = {};
+    uint64_t busiestTick = 0, busiestActions = 0;
+
+    void merge(const LogStats& o) {
+        records += o.records; actions += o.actions; rejected += o.rejected; joins += o.joins;
+        for (size_t k = 0; k < size_t(ActionKind::Count); k++) byKind[k] += o.byKind[k];
+        if (o.busiestActions > busiestActions) { busiestActions = o.busiestActions; busiestTick = o.busiestTick; }
+    }
+};
+
+// Splits ticks [from, to] into one range per worker and scans them in
+// parallel, each thread with its own cursor over the shared mapping
+int runLogStats(const SimConfig& cfg) {
+    TickLogReader log;
+    if (!log.open(cfg.logStatsPath)) { std::fprintf(stderr, "cannot read tick log %s\n", cfg.logStatsPath.c_str()); return 1; }
+    uint64_t from = std::max(cfg.fromTick, log.firstTick), to = std::min(cfg.toTick, log.lastTick);
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    uint32_t threads = uint32_t(cfg.workers ? cfg.workers : int(cores));
+    uint64_t span = to >= from ? to - from + 1 : 0;
+    if (threads > span) threads = uint32_t(std::max<uint64_t>(span, 1));
+    std::vector<LogStats> parts(threads);
+
+    int64_t t0 = nowNs();
+    std::vector<std::thread> pool;
+    for (uint32_t t = 0; t < threads; t++) {
+        pool.emplace_back([&, t] {
+            uint64_t lo = from + span * t / threads, hi = from + span * (t + 1) / threads; // [lo, hi)
+            LogStats& st = parts[t];
+            TickRecord rec;
+            TickLogReader::Cursor c = log.seek(lo);
+            while (c.next(rec) && rec.tick < hi) {
+                st.records++;
+                st.actions += rec.actions.size();
+                st.joins += rec.joins.size();
+                for (const GameAction& a : rec.actions) { st.byKind[size_t(a.kind)]++; if (a.illegal()) st.rejected++; }
+                if (rec.actions.size() > st.busiestActions) { st.busiestActions = rec.actions.size(); st.busiestTick = rec.tick; }
+            }
+        });
+    }
+    for (auto& th : pool) th.join();
+    double elapsed = double(nowNs() - t0) / 1e9;
+    LogStats total;
+    for (auto& p : parts) total.merge(p);
+
+    std::vector<Metric> metrics = {
+        { "log_bytes", double(log.bytes()) }, { "log_indexed", log.indexed ? 1.0 : 0.0 }, { "index_entries", double(log.indexEntries()) },
+        { "first_tick", double(from) }, { "last_tick", double(to) }, { "threads", double(threads) },
+        { "records", double(total.records) }, { "actions", double(total.actions) }, { "rejected", double(total.rejected) },
+        { "joins", double(total.joins) },
+        { "moves", double(total.byKind[size_t(ActionKind::Move)]) }, { "jumps", double(total.byKind[size_t(ActionKind::Jump)]) },
+        { "shoots", double(total.byKind[size_t(ActionKind::Shoot)]) },
+        { "busiest_tick", double(total.busiestTick) }, { "busiest_tick_actions", double(total.busiestActions) },
+        { "scan_s", elapsed },
+    };
+    printMetrics(metrics, cfg.csv, nullptr);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    SimConfig cfg;
+    if (!parseArgs(argc, argv, cfg)) { printUsage(argv[0]); return 1; }
+    configureWorld(cfg.worldCols, cfg.worldRows);
+    scatterSpawns = cfg.scatterSpawns;
+    ruleLimits.windowTicks = uint32_t(cfg.tickHz);
+    tickSeconds = 1.0f / float(cfg.tickHz);
+    placement = cfg.placement;
+#ifndef HAVE_THREAD_AFFINITY
+    if (placement.any()) { std::fprintf(stderr, "--pin-* needs pthread_setaffinity_np (Linux)\n"); return 1; }
+#endif
+    if (cfg.benchWire) { runWireBenchmark(cfg); return 0; }
+    if (cfg.benchMicro) { runMicroBenchmark(cfg); return 0; }
+    if (!cfg.logStatsPath.empty()) return runLogStats(cfg);
+    if (!cfg.statsPath.empty()) {
+#if AE_INSTRUMENT
+        statsExporter.start(cfg.statsPath, cfg.statsIntervalMs);
+#else
+        std::fprintf(stderr, "--stats-file needs a build with AE_INSTRUMENT=1\n");
+        return 1;
+#endif
+    }
+    actionQueue.reset(cfg.queueCapacity, cfg.queuePolicy);
+    ingress.configure(cfg.clientRateLimit, cfg.clientBurst, cfg.ingressBudget);
+    lastCheaterID = cfg.cheaters > 0 ? uint32_t(cfg.clientIdBase + cfg.cheaters) : 0;
+    actionHistory.reset(cfg.historyCapacity);
+    aoiRadius = cfg.aoiRadius;
+    shards = std::vector<Shard>(size_t(cfg.shards));
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    shardScheduler.start(uint32_t(cfg.workers ? cfg.workers : std::min(cfg.shards, int(cores))));
+    rngSeed = cfg.seed;
+    if (!cfg.replayPath.empty()) {
+        int rc = runReplay(cfg);
+        shardScheduler.stop();
+        return rc;
+    }
+    if (!cfg.recordPath.empty() && !tickLog.open(cfg.recordPath, uint32_t(cfg.tickHz), cfg.seed, uint16_t(world.width()), uint16_t(world.height()),
+                                                     scatterSpawns ? TICK_LOG_SCATTER_SPAWNS : 0)) {
+        std::fprintf(stderr, "cannot write tick log %s\n", cfg.recordPath.c_str());
+        return 1;
+    }
+    // The log tail is re-recorded, so the new log continues from the same checkpoint
+    if (!cfg.resumePath.empty() && !resumeServer(cfg)) { shardScheduler.stop(); return 2; }
+    if (!cfg.checkpointPath.empty()) {
+        checkpointWriter.start(cfg.checkpointPath);
+        checkpointEvery = cfg.checkpointEvery;
+    }
+
+    // Disable buffering for live output
+    setvbuf(stdout, nullptr, _IONBF, 0);
+#ifdef _WIN32
+    EnableVTMode();
+#endif
+    if (!validateMovesMatchesScalar()) {
+        std::fprintf(stderr, "validateMoves disagrees with validateMovesScalar in this build\n");
+        return 1;
+    }
+    if (!integrateVerticalMatchesScalar()) {
+        std::fprintf(stderr, "integrateVertical disagrees with integrateVerticalScalar in this build\n");
+        return 1;
+    }
+
+    std::vector<int> clientIDs;
+    std::vector<std::thread> clients;
+    for (int i = 1; i <= cfg.clients; i++) clientIDs.push_back(cfg.clientIdBase + i);
+
+    bool runServer = cfg.connectPort == 0;
+#ifdef HAVE_UDP_TRANSPORT
+    std::unique_ptr<UdpServerTransport> udpServer;
+    if (cfg.listenPort) {
+        udpServer.reset(new UdpServerTransport(cfg.listenPort));
+        if (!udpServer->ok()) { std::fprintf(stderr, "cannot listen on UDP port %d\n", cfg.listenPort); return 1; }
+        serverTransport = udpServer.get();
+        udpServerHost = "127.0.0.1";
+        udpServerPort = cfg.listenPort;
+    }
+    if (cfg.connectPort) { udpServerHost = cfg.connectHost; udpServerPort = cfg.connectPort; }
+    if (!cfg.clusterPorts.empty()) {
+        if (cfg.clusterPorts.size() > size_t(world.width())) { std::fprintf(stderr, "--cluster: more nodes than world columns\n"); return 1; }
+        // Peers are recognised by source address, so list them as the other nodes (and clients) reach them
+        std::vector<sockaddr_in> addrs;
+        for (size_t k = 0; k < cfg.clusterPorts.size(); k++) {
+            addrinfo hints = {}, *res = nullptr;
+            hints.ai_family = AF_INET;
+            hints.ai_socktype = SOCK_DGRAM;
+            if (getaddrinfo(cfg.clusterHosts[k].c_str(), std::to_string(cfg.clusterPorts[k]).c_str(), &hints, &res) != 0 || !res) {
+                std::fprintf(stderr, "--cluster: cannot resolve %s\n", cfg.clusterHosts[k].c_str());
+                return 1;
+            }
+            sockaddr_in a;
+            std::memcpy(&a, res->ai_addr, sizeof(a));
+            freeaddrinfo(res);
+            addrs.push_back(a);
+        }
+        cluster.configure(uint32_t(cfg.node), uint32_t(addrs.size()));
+        udpServer->attachCluster(cluster, addrs);
+    }
+#else
+    if (cfg.listenPort || cfg.connectPort) { std::fprintf(stderr, "UDP transport needs recvmmsg/sendmmsg (Linux)\n"); return 1; }
+#endif
+
+    clientReceived.init(size_t(cfg.clientIdBase) + size_t(cfg.clients) + 1);
+    clientPredicted.init(clientReceived.size());
+    auto start = std::chrono::steady_clock::now();
+    std::thread server, render;
+    if (runServer) server = std::thread(serverThread, clientIDs, cfg.latencyMs, cfg.tickHz);
+    if (cfg.render) render = std::thread(renderThread, RENDER_INTERVAL_MS);
+    if (cfg.clientPool > 0) clientPool.start(clientIDs, size_t(cfg.clientPool), cfg.actionRate, cfg.rateSpread, cfg.mix, lastCheaterID);
+    else for (int id : clientIDs)
+        clients.emplace_back(clientThread, id, cfg.actionRate, cfg.rateSpread, uint32_t(id) <= lastCheaterID ? Behaviour::Cheater : cfg.mix.pick(uint32_t(id)));
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(cfg.durationSec));
+    done = true;
+    actionQueue.close();
+
+    for (auto& c : clients) c.join();
+    clientPool.join();
+    if (server.joinable()) server.join();
+    shardScheduler.stop();
+    checkpointWriter.stop();
+#if AE_INSTRUMENT
+    statsExporter.stop();
+#endif
+    tickLog.close();
+    if (render.joinable()) render.join();
+    double elapsedSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (!runServer) {
+        std::cout << "Clients " << cfg.clientIdBase + 1 << ".." << cfg.clientIdBase + cfg.clients << " finished against "
+                  << cfg.connectHost << ":" << cfg.connectPort << " (prediction: reconciles=" << predictionReconciles.load()
+                  << " corrections=" << predictionCorrections.load() << " redirects=" << clientRedirects.load() << ")\n";
+        return 0;
+    }
+
+    if (cfg.bench) {
+        printReport(cfg, elapsedSec);
+        return 0;
+    }
+
+    std::cout << "\nFinal penalties:\n";
+    for (size_t i = 0; i < serverState.size(); i++)
+        if (serverState.alive[i] && serverState.penalty[i] > 0) std::cout << "Client " << serverState.ids[i] << "=" << serverState.penalty[i] << "\n";
+    auto qs = actionQueue.stats();
+    std::cout << "Queue: pushed=" << qs.pushed << " popped=" << qs.popped << " blocked=" << qs.blocked
+              << " droppedOldest=" << qs.droppedOldest << " rejected=" << qs.rejected << "\n";
+    std::cout << "Simulation finished.\n";
+    return 0;
+}